@@ -0,0 +1,444 @@
+#ifndef AUGMENTEDAVL_H
+#define AUGMENTEDAVL_H
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include "avlbst.h"
+
+/*
+ * Monoids for AugmentedAVLTree. A monoid provides
+ *   typedef ... value_type;
+ *   value_type identity() const;
+ *   value_type combine(const value_type& a, const value_type& b) const;   // associative
+ *   value_type lift(const Key& key, const Value& value) const;           // one entry
+ * combine need not be commutative; aggregates are always folded in key order.
+ */
+
+/**
+ * Sum of values.
+ */
+template <typename T>
+struct SumAggregate
+{
+    typedef T value_type;
+    T identity() const { return T(); }
+    T combine(const T& a, const T& b) const { return a + b; }
+    template <typename Key>
+    T lift(const Key&, const T& value) const { return value; }
+};
+
+/**
+ * Minimum value.
+ */
+template <typename T>
+struct MinAggregate
+{
+    typedef T value_type;
+    T identity() const { return std::numeric_limits<T>::max(); }
+    T combine(const T& a, const T& b) const { return std::min(a, b); }
+    template <typename Key>
+    T lift(const Key&, const T& value) const { return value; }
+};
+
+/**
+ * Maximum value.
+ */
+template <typename T>
+struct MaxAggregate
+{
+    typedef T value_type;
+    T identity() const { return std::numeric_limits<T>::lowest(); }
+    T combine(const T& a, const T& b) const { return std::max(a, b); }
+    template <typename Key>
+    T lift(const Key&, const T& value) const { return value; }
+};
+
+/**
+ * An AVLNode that also stores the monoid aggregate of its subtree.
+ */
+template <typename Key, typename Value, typename Monoid>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    typedef typename Monoid::value_type Aggregate;
+
+    AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent, const Aggregate& aggregate);
+
+    const Aggregate& getAggregate() const;
+    void setAggregate(const Aggregate& aggregate);
+
+protected:
+    Aggregate aggregate_;
+};
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLNode<Key, Value, Monoid>::AugmentedAVLNode(const Key& key, const Value& value,
+                                                       AVLNode<Key, Value>* parent, const Aggregate& aggregate) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_(aggregate)
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+const typename Monoid::value_type& AugmentedAVLNode<Key, Value, Monoid>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLNode<Key, Value, Monoid>::setAggregate(const Aggregate& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+/**
+ * An AVL tree that maintains a user-supplied monoid over every subtree
+ * and answers range aggregates in O(log n).
+ *
+ * Aggregates are recomputed locally on each rotation and along the
+ * changed path on insert/remove via the AVLTree augmentation hooks,
+ * which only trees on AVLTree<Key, Value, VirtualAugment> call; a plain
+ * AVLTree<Key, Value> compiles them away.
+ *
+ * Values are read-only from outside: iterators and operator[] give
+ * const access, and insert() overwrites an existing key's value and
+ * refreshes the aggregates above it.
+ */
+template <typename Key, typename Value, typename Monoid>
+class AugmentedAVLTree : private AVLTree<Key, Value, VirtualAugment>
+{
+public:
+    typedef AVLTree<Key, Value, VirtualAugment> Base;
+    typedef typename Base::node_type node_type;
+    typedef typename Monoid::value_type Aggregate;
+
+    AugmentedAVLTree(const Monoid& monoid = Monoid());
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Monoid>;
+        explicit iterator(const typename Base::iterator& it);
+        typename Base::iterator it_;
+    };
+
+    // takes pair<Key, Value> so that it does not override the base's insert()
+    std::pair<iterator, bool> insert(const std::pair<Key, Value>& keyValuePair);
+    std::pair<iterator, bool> insert(node_type&& handle);
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+
+    using Base::remove;
+    using Base::clear;
+    using Base::compact;
+    using Base::empty;
+    using Base::size;
+    using Base::isBalanced;
+    using Base::validate;
+    using Base::print;
+    using Base::memory_usage;
+
+    Aggregate aggregate() const;
+    Aggregate aggregate(const Key& lo, const Key& hi) const;
+
+protected:
+    typedef AugmentedAVLNode<Key, Value, Monoid> AugNode;
+
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) override;
+    virtual void updateAugment(AVLNode<Key, Value>* node) override;
+    virtual void updateAugmentPath(AVLNode<Key, Value>* node) override;
+    virtual AVLNode<Key, Value>* relocateNode(AVLNode<Key, Value>* node, void* where) override;
+    virtual size_t nodeBytes() const override;
+    virtual const std::type_info& nodeType() const override;
+    virtual bool validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const override;
+
+    static AugNode* asAug(Node<Key, Value>* node);
+    Aggregate subtree(Node<Key, Value>* node) const;
+    Aggregate recompute(Node<Key, Value>* node) const;
+
+    Monoid monoid_;
+};
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::iterator::iterator()
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::iterator::iterator(const typename Base::iterator& it) : it_(it)
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+const std::pair<const Key, Value>& AugmentedAVLTree<Key, Value, Monoid>::iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class Monoid>
+const std::pair<const Key, Value>* AugmentedAVLTree<Key, Value, Monoid>::iterator::operator->() const
+{
+    return &*it_;
+}
+
+template<class Key, class Value, class Monoid>
+bool AugmentedAVLTree<Key, Value, Monoid>::iterator::operator==(const iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class Monoid>
+bool AugmentedAVLTree<Key, Value, Monoid>::iterator::operator!=(const iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator& AugmentedAVLTree<Key, Value, Monoid>::iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::AugmentedAVLTree(const Monoid& monoid) : monoid_(monoid)
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid>::insert(const std::pair<Key, Value>& keyValuePair)
+{
+    std::pair<typename Base::iterator, bool> result = Base::insert(std::pair<const Key, Value>(keyValuePair));
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Monoid>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid>::insert(node_type&& handle)
+{
+    std::pair<typename Base::iterator, bool> result = Base::insert(std::move(handle));
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::erase(iterator pos)
+{
+    return iterator(Base::erase(pos.it_));
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator
+AugmentedAVLTree<Key, Value, Monoid>::erase(iterator first, iterator last)
+{
+    return iterator(Base::erase(first.it_, last.it_));
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::node_type AugmentedAVLTree<Key, Value, Monoid>::extract(const Key& key)
+{
+    return Base::extract(key);
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::node_type AugmentedAVLTree<Key, Value, Monoid>::extract(iterator pos)
+{
+    return Base::extract(pos.it_);
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::begin() const
+{
+    return iterator(Base::begin());
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::end() const
+{
+    return iterator(Base::end());
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::find(const Key& key) const
+{
+    return iterator(Base::find(key));
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::lower_bound(const Key& key) const
+{
+    return iterator(Base::lower_bound(key));
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::upper_bound(const Key& key) const
+{
+    return iterator(Base::upper_bound(key));
+}
+
+/**
+ * Throws std::out_of_range for a missing key, as the base does.
+ */
+template<class Key, class Value, class Monoid>
+const Value& AugmentedAVLTree<Key, Value, Monoid>::operator[](const Key& key) const
+{
+    return Base::operator[](key);
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLNode<Key, Value, Monoid>* AugmentedAVLTree<Key, Value, Monoid>::asAug(Node<Key, Value>* node)
+{
+    return static_cast<AugNode*>(node);
+}
+
+/**
+ * The stored aggregate of a subtree, or identity for an empty one.
+ */
+template<class Key, class Value, class Monoid>
+typename Monoid::value_type AugmentedAVLTree<Key, Value, Monoid>::subtree(Node<Key, Value>* node) const
+{
+    return node == NULL ? monoid_.identity() : asAug(node)->getAggregate();
+}
+
+/**
+ * left + self + right, from the children's stored aggregates.
+ */
+template<class Key, class Value, class Monoid>
+typename Monoid::value_type AugmentedAVLTree<Key, Value, Monoid>::recompute(Node<Key, Value>* node) const
+{
+    return monoid_.combine(subtree(node->getLeft()),
+                           monoid_.combine(monoid_.lift(node->getKey(), node->getValue()),
+                                           subtree(node->getRight())));
+}
+
+/**
+ * Aggregate over the whole tree.
+ */
+template<class Key, class Value, class Monoid>
+typename Monoid::value_type AugmentedAVLTree<Key, Value, Monoid>::aggregate() const
+{
+    return subtree(this->root_);
+}
+
+/**
+ * Aggregate over all keys in [lo, hi], folded in key order.
+ *
+ * Finds the node where the searches for lo and hi split, then walks each
+ * boundary path once, taking whole stored subtrees that lie inside the
+ * range, so at most two root-to-leaf paths are visited.
+ */
+template<class Key, class Value, class Monoid>
+typename Monoid::value_type AugmentedAVLTree<Key, Value, Monoid>::aggregate(const Key& lo, const Key& hi) const
+{
+    Node<Key, Value>* split = this->root_;
+    while (split != NULL && (split->getKey() < lo || hi < split->getKey())) {
+        split = (split->getKey() < lo) ? split->getRight() : split->getLeft();
+    }
+    if (split == NULL) {
+        return monoid_.identity();
+    }
+
+    // keys >= lo in the left subtree; accumulated right-to-left
+    Aggregate leftPart = monoid_.identity();
+    for (Node<Key, Value>* n = split->getLeft(); n != NULL; ) {
+        if (n->getKey() < lo) {
+            n = n->getRight();
+        } else {
+            leftPart = monoid_.combine(monoid_.lift(n->getKey(), n->getValue()),
+                                       monoid_.combine(subtree(n->getRight()), leftPart));
+            n = n->getLeft();
+        }
+    }
+
+    // keys <= hi in the right subtree; accumulated left-to-right
+    Aggregate rightPart = monoid_.identity();
+    for (Node<Key, Value>* n = split->getRight(); n != NULL; ) {
+        if (hi < n->getKey()) {
+            n = n->getLeft();
+        } else {
+            rightPart = monoid_.combine(monoid_.combine(rightPart, subtree(n->getLeft())),
+                                        monoid_.lift(n->getKey(), n->getValue()));
+            n = n->getRight();
+        }
+    }
+
+    return monoid_.combine(leftPart,
+                           monoid_.combine(monoid_.lift(split->getKey(), split->getValue()), rightPart));
+}
+
+template<class Key, class Value, class Monoid>
+AVLNode<Key, Value>* AugmentedAVLTree<Key, Value, Monoid>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AugNode(key, value, parent, monoid_.lift(key, value));
+}
+
+template<class Key, class Value, class Monoid>
+AVLNode<Key, Value>* AugmentedAVLTree<Key, Value, Monoid>::relocateNode(AVLNode<Key, Value>* node, void* where)
+{
+    return new (where) AugNode(*asAug(node));
+}
+
+template<class Key, class Value, class Monoid>
+size_t AugmentedAVLTree<Key, Value, Monoid>::nodeBytes() const
+{
+    return sizeof(AugNode);
+}
+
+template<class Key, class Value, class Monoid>
+const std::type_info& AugmentedAVLTree<Key, Value, Monoid>::nodeType() const
+{
+    return typeid(AugNode);
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::updateAugment(AVLNode<Key, Value>* node)
+{
+    asAug(node)->setAggregate(recompute(node));
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::updateAugmentPath(AVLNode<Key, Value>* node)
+{
+    while (node != NULL) {
+        updateAugment(node);
+        node = node->getParent();
+    }
+}
+
+/**
+ * Besides the AVL checks, the stored aggregate must match the one
+ * recomputed from the (already validated) children.
+ */
+template<class Key, class Value, class Monoid>
+bool AugmentedAVLTree<Key, Value, Monoid>::validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    if (!Base::validateNode(node, leftHeight, rightHeight)) {
+        return false;
+    }
+    return asAug(node)->getAggregate() == recompute(node);
+}
+
+#endif
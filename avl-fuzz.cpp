@@ -0,0 +1,189 @@
+// Differential fuzz harness for AVLTree.
+//
+// Drives an AVLTree and a std::map with the same operation stream, checks
+// that every lookup agrees and that validate() holds after each mutation,
+// and records per-operation latency histograms (latency.h) so rotation
+// changes can be gated on tail latency as well as correctness.
+//
+// Randomized driver (default):
+//   make avl-fuzz
+//   ./avl-fuzz [ops] [keyspace] [seed] [max-p99-ns]
+//
+// libFuzzer build (the fuzzer supplies main):
+//   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address -DLIBFUZZER avl-fuzz.cpp -o avl-fuzz-lf
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "avlbst.h"
+#include "latency.h"
+
+using namespace std;
+
+enum FuzzOp { OP_INSERT, OP_REMOVE, OP_FIND, OP_ITERATE, NUM_OPS };
+
+static const char* opNames[NUM_OPS] = { "insert", "remove", "find", "iterate" };
+
+struct FuzzState
+{
+    AVLTree<int, int> tree;
+    map<int, int> ref;
+    LatencyHistogram latency[NUM_OPS];
+    bool validateEachOp;
+    uint64_t opCount;
+};
+
+static void fail(const char* what, int key)
+{
+    cerr << "avl-fuzz: " << what << " (key " << key << ")" << endl;
+    abort();
+}
+
+static LatencyClock latencyClock;
+
+static uint64_t nowNs()
+{
+    return latencyClock.toNanos(latencyClock.now());
+}
+
+// Compare the full in-order contents of the tree against the reference.
+static void checkContents(FuzzState& st)
+{
+    map<int, int>::const_iterator ref = st.ref.begin();
+    for (AVLTree<int, int>::iterator it = st.tree.begin(); it != st.tree.end(); ++it, ++ref) {
+        if (ref == st.ref.end() || ref->first != it->first || ref->second != it->second) {
+            fail("iteration mismatch", it->first);
+        }
+    }
+    if (ref != st.ref.end()) {
+        fail("iteration ended early", ref->first);
+    }
+}
+
+// Apply one operation to both containers and time the AVLTree side.
+static void applyOp(FuzzState& st, FuzzOp op, int key, int value)
+{
+    uint64_t start, stop;
+    switch (op) {
+    case OP_INSERT:
+        // alternate between insert() and the inserting operator[]
+        start = nowNs();
+        if (value & 1) {
+            st.tree[key] = value;
+        } else {
+            st.tree.insert(make_pair(key, value));
+        }
+        stop = nowNs();
+        st.ref[key] = value;
+        break;
+    case OP_REMOVE:
+        // alternate between remove() and erase() of a found iterator
+        start = nowNs();
+        if (value & 1) {
+            AVLTree<int, int>::iterator it = st.tree.find(key);
+            if (it != st.tree.end()) st.tree.erase(it);
+        } else {
+            st.tree.remove(key);
+        }
+        stop = nowNs();
+        st.ref.erase(key);
+        break;
+    case OP_FIND: {
+        start = nowNs();
+        AVLTree<int, int>::iterator it = st.tree.find(key);
+        stop = nowNs();
+        map<int, int>::iterator ref = st.ref.find(key);
+        if ((it == st.tree.end()) != (ref == st.ref.end())) fail("find presence mismatch", key);
+        if (ref != st.ref.end() && it->second != ref->second) fail("find value mismatch", key);
+        break;
+    }
+    default:
+        start = nowNs();
+        checkContents(st);
+        stop = nowNs();
+        break;
+    }
+    st.latency[op].record(stop - start);
+    st.opCount++;
+
+    if ((op == OP_INSERT || op == OP_REMOVE) && st.validateEachOp && !st.tree.validate()) {
+        fail("validate() failed", key);
+    }
+}
+
+static void report(const FuzzState& st, uint64_t& insertP99)
+{
+    cout << left << setw(10) << "op" << right << setw(10) << "count"
+         << setw(10) << "p50" << setw(10) << "p90" << setw(10) << "p99"
+         << setw(10) << "p999" << setw(12) << "max(ns)" << endl;
+    for (int op = 0; op < NUM_OPS; ++op) {
+        const LatencyHistogram& h = st.latency[op];
+        uint64_t p99 = h.percentile(99);
+        if (op == OP_INSERT) insertP99 = p99;
+        cout << left << setw(10) << opNames[op] << right << setw(10) << h.count()
+             << setw(10) << h.percentile(50) << setw(10) << h.percentile(90)
+             << setw(10) << p99 << setw(10) << h.percentile(99.9)
+             << setw(12) << h.max() << endl;
+    }
+}
+
+// Each operation consumes 4 bytes: opcode, key (2 bytes), value.
+// A narrow key space keeps collisions, overwrites and removals frequent.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzState st;
+    st.validateEachOp = true;
+    st.opCount = 0;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        FuzzOp op = (FuzzOp)(data[i] % NUM_OPS);
+        int key = (int)((data[i + 1] << 8) | data[i + 2]) % 512;
+        applyOp(st, op, key, data[i + 3]);
+    }
+    checkContents(st);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+int main(int argc, char* argv[])
+{
+    uint64_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+    int keyspace = argc > 2 ? atoi(argv[2]) : 4096;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 104;
+    uint64_t maxP99 = argc > 4 ? strtoull(argv[4], NULL, 10) : 0;
+
+    srand(seed);
+    FuzzState st;
+    // validate() is O(n); checking after every op would make the run
+    // quadratic, so sample it instead and always check at the end.
+    st.validateEachOp = false;
+    st.opCount = 0;
+
+    for (uint64_t i = 0; i < ops; ++i) {
+        int r = rand() % 100;
+        FuzzOp op = r < 45 ? OP_INSERT : r < 75 ? OP_REMOVE : r < 99 ? OP_FIND : OP_ITERATE;
+        applyOp(st, op, rand() % keyspace, rand());
+        if (i % 1024 == 0 && !st.tree.validate()) {
+            fail("validate() failed", -1);
+        }
+    }
+    if (!st.tree.validate()) fail("validate() failed", -1);
+    checkContents(st);
+
+    cout << "avl-fuzz: " << st.opCount << " ops over " << keyspace
+         << " keys, seed " << seed << ", final size " << st.ref.size() << endl;
+    uint64_t insertP99 = 0;
+    report(st, insertP99);
+
+    if (maxP99 != 0 && insertP99 > maxP99) {
+        cerr << "avl-fuzz: insert p99 " << insertP99 << "ns exceeds gate of "
+             << maxP99 << "ns" << endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <functional>
+#include <new>
 #include "bst.h"
 
 struct KeyError { };
@@ -127,74 +129,183 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
+/**
+ * Augmentation policies for AVLTree: how it refreshes per-node data
+ * after a node's children change (update) and after an insert, remove
+ * or value overwrite (updatePath, from the lowest changed node). The
+ * default keeps nothing, so the calls compile away and a plain AVLTree
+ * pays nothing for the hooks.
+ */
+struct NoAugment
+{
+    template <typename Tree, typename NodeType>
+    static void update(Tree&, NodeType*) {}
+    template <typename Tree, typename NodeType>
+    static void updatePath(Tree&, NodeType*) {}
+};
+
+/**
+ * For trees that keep per-node data of their own: dispatches to their
+ * updateAugment()/updateAugmentPath() overrides.
+ */
+struct VirtualAugment
+{
+    template <typename Tree, typename NodeType>
+    static void update(Tree& tree, NodeType* node) { tree.updateAugment(node); }
+    template <typename Tree, typename NodeType>
+    static void updatePath(Tree& tree, NodeType* node) { tree.updateAugmentPath(node); }
+};
+
+template <class Key, class Value, class Augment = NoAugment>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+    typedef typename BinarySearchTree<Key, Value>::node_type node_type;
+
+    AVLTree();
+    virtual ~AVLTree();
+
+    using BinarySearchTree<Key, Value>::insert;
+    virtual std::pair<iterator, bool> insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+    virtual void rebalance() override;
+    size_t compact();
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual bool validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const override;
+
+    // Augmentation hooks for subclasses that keep per-subtree data.
+    // makeNode() lets them allocate a derived node type; updateAugment()
+    // recomputes one node from its children and runs on both nodes of
+    // every rotation; updateAugmentPath() runs once per insert/remove,
+    // before any rebalancing, from the lowest changed node. The last two
+    // are only called for trees built on AVLTree<Key, Value, VirtualAugment>.
+    friend struct VirtualAugment;
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void updateAugment(AVLNode<Key, Value>* node);
+    virtual void updateAugmentPath(AVLNode<Key, Value>* node);
+
+    // compact() hooks: relocateNode() copy-constructs a node of the
+    // tree's node type at where, and nodeBytes() is that type's size.
+    virtual AVLNode<Key, Value>* relocateNode(AVLNode<Key, Value>* node, void* where);
+    virtual size_t nodeBytes() const override;
+    virtual void destroyNode(Node<Key, Value>* node) override;
+    bool inArena(Node<Key, Value>* node) const;
+    virtual size_t balanceBytes() const override;
+    virtual size_t heapNodeBytes(Node<Key, Value>* node) const override;
+    virtual size_t storageBytes() const override;
 
     // Add helper functions here
     void rotateLeft(AVLNode<Key, Value>* node);
     void rotateRight(AVLNode<Key, Value>* node);
     void insertFix(AVLNode<Key, Value>* node, AVLNode<Key, Value>* p);
     void removeFix(AVLNode<Key, Value>* n, int diff);
-    void insertLeft(const std::pair<const Key, Value> &new_item, AVLNode<Key, Value> *parent);
-    void insertRight(const std::pair<const Key, Value> &new_item, AVLNode<Key, Value> *parent);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* parent, bool left, const Key& key, const Value& value) override;
+    virtual Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* unlinkNode(Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* releaseNode(Node<Key, Value>* node) override;
+    virtual void clearHelper(Node<Key, Value>* node) override;
+    void publishUsage();
+    virtual void assignValue(Node<Key, Value>* node, const Value& value) override;
+    virtual const std::type_info& nodeType() const override;
+    AVLNode<Key, Value>* insertLeft(AVLNode<Key, Value>* new_node, AVLNode<Key, Value> *parent);
+    AVLNode<Key, Value>* insertRight(AVLNode<Key, Value>* new_node, AVLNode<Key, Value> *parent);
     void fixLeftSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node);
     void fixRightSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node);
     void fixLeftRightCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node);
     void fixRightLeftCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node);
     void removefixLeft(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff);
     void removefixRight(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff);
+
+    // Block holding the nodes laid out by the last compact(), and how
+    // many of them are still in the tree; freed when that reaches 0.
+    char* arena_;
+    size_t arenaBytes_;
+    size_t arenaLive_;
+
+    // Heap bytes of the linked nodes outside the arena, and this tree's
+    // entry in MemoryRegistry, republished whenever nodes come or go.
+    size_t heapBytes_;
+    MemoryRegistry::Entry registration_;
 };
 
+template<class Key, class Value, class Augment>
+AVLTree<Key, Value, Augment>::AVLTree() : arena_(NULL), arenaBytes_(0), arenaLive_(0), heapBytes_(0)
+{
+
+}
+
+/**
+ * Clears here rather than in ~BinarySearchTree so that destroyNode()
+ * still dispatches to the arena-aware version.
+ */
+template<class Key, class Value, class Augment>
+AVLTree<Key, Value, Augment>::~AVLTree()
+{
+    this->clear();
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item) {
-    if (this->root_ == nullptr) {
-        AVLNode<Key, Value>* new_root = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-        new_root->setBalance(0);
-        new_root->setLeft(nullptr);
-        new_root->setRight(nullptr);
-        this->root_ = new_root;
-        return;
+template<class Key, class Value, class Augment>
+std::pair<typename AVLTree<Key, Value, Augment>::iterator, bool>
+AVLTree<Key, Value, Augment>::insert(const std::pair<const Key, Value> &new_item) {
+    this->traceOp(TRACE_INSERT, new_item.first);
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* existing = this->locate(new_item.first, parent, left);
+    if (existing != nullptr) {
+        assignValue(existing, new_item.second);
+        return std::make_pair(this->iteratorFor(existing), false);
     }
+    Node<Key, Value>* node = attachNode(parent, left, new_item.first, new_item.second);
+    return std::make_pair(this->iteratorFor(node), true);
+}
 
-    AVLNode<Key, Value>* current_node = static_cast<AVLNode<Key, Value>*>(this->root_);
-    while (current_node != nullptr) {
-        if (current_node->getKey() > new_item.first) {
-            if (current_node->getLeft() != nullptr) {
-                current_node = current_node->getLeft();
-            } else {
-                insertLeft(new_item, current_node);
-                return;
-            }
-        } else if (current_node->getKey() < new_item.first) {
-            if (current_node->getRight() != nullptr) {
-                current_node = current_node->getRight();
-            } else {
-                insertRight(new_item, current_node);
-                return;
-            }
-        } else { 
-            current_node->setValue(new_item.second);
-            return;
-        }
+/*
+ * Creates a node where locate() said it belongs and retraces; only
+ * reached when a node is actually created.
+ */
+template<class Key, class Value, class Augment>
+Node<Key, Value>* AVLTree<Key, Value, Augment>::attachNode(Node<Key, Value>* parent, bool left, const Key& key, const Value& value) {
+    return linkNode(parent, left, makeNode(key, value, static_cast<AVLNode<Key, Value>*>(parent)));
+}
+
+/*
+ * Links a node of nodeType(), either fresh from makeNode() or adopted
+ * from extract(), and retraces.
+ */
+template<class Key, class Value, class Augment>
+Node<Key, Value>* AVLTree<Key, Value, Augment>::linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node) {
+    AVLNode<Key, Value>* new_node = static_cast<AVLNode<Key, Value>*>(node);
+    heapBytes_ += heapNodeBytes(node);
+    new_node->setLeft(nullptr);
+    new_node->setRight(nullptr);
+    if (parent == nullptr) {
+        new_node->setParent(nullptr);
+        new_node->setBalance(0);
+        Augment::update(*this, new_node);
+        this->root_ = new_node;
+        this->size_++;
+        publishUsage();
+        return new_node;
     }
+    this->size_++;
+    AVLNode<Key, Value>* avlParent = static_cast<AVLNode<Key, Value>*>(parent);
+    Node<Key, Value>* linked = left ? insertLeft(new_node, avlParent) : insertRight(new_node, avlParent);
+    publishUsage();
+    return linked;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertLeft(const std::pair<const Key, Value> &new_item, AVLNode<Key, Value>* parent) {
-    AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value>* AVLTree<Key, Value, Augment>::insertLeft(AVLNode<Key, Value>* new_node, AVLNode<Key, Value>* parent) {
     parent->setLeft(new_node);
     new_node->setParent(parent);
     new_node->setBalance(0);
+    Augment::updatePath(*this, new_node);
 
     if (parent->getBalance() == 1 || parent->getBalance() == -1) {
         parent->setBalance(0);
@@ -202,14 +313,15 @@ void AVLTree<Key, Value>::insertLeft(const std::pair<const Key, Value> &new_item
         parent->updateBalance(-1);
         insertFix(new_node, parent);
     }
+    return new_node;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertRight(const std::pair<const Key, Value> &new_item, AVLNode<Key, Value>* parent) {
-    AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value>* AVLTree<Key, Value, Augment>::insertRight(AVLNode<Key, Value>* new_node, AVLNode<Key, Value>* parent) {
     parent->setRight(new_node);
     new_node->setParent(parent);
     new_node->setBalance(0);
+    Augment::updatePath(*this, new_node);
 
     if (parent->getBalance() == 1 || parent->getBalance() == -1) {
         parent->setBalance(0);
@@ -217,6 +329,7 @@ void AVLTree<Key, Value>::insertRight(const std::pair<const Key, Value> &new_ite
         parent->updateBalance(1);
         insertFix(new_node, parent);
     }
+    return new_node;
 }
 
 
@@ -224,13 +337,25 @@ void AVLTree<Key, Value>::insertRight(const std::pair<const Key, Value> &new_ite
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key) {
-    AVLNode<Key, Value>* node_to_remove = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::remove(const Key& key) {
+    this->traceOp(TRACE_REMOVE, key);
+    Node<Key, Value>* node = this->internalFind(key);
 
-    if (node_to_remove == nullptr) {
+    if (node == nullptr) {
         return; 
     }
+    this->removeNode(node);
+}
+
+/*
+ * Takes a node out of the tree and retraces, leaving it allocated for
+ * removeNode() or extract().
+ */
+template<class Key, class Value, class Augment>
+Node<Key, Value>* AVLTree<Key, Value, Augment>::unlinkNode(Node<Key, Value>* node) {
+    AVLNode<Key, Value>* node_to_remove = static_cast<AVLNode<Key, Value>*>(node);
+    heapBytes_ -= heapNodeBytes(node);
 
     if (node_to_remove->getLeft() != nullptr && node_to_remove->getRight() != nullptr) {
         AVLNode<Key, Value>* predecessor = static_cast<AVLNode<Key, Value>*>(this->predecessor(node_to_remove));
@@ -257,14 +382,17 @@ void AVLTree<Key, Value>::remove(const Key& key) {
         }
     }
 
-    delete node_to_remove;
+    this->size_--;
 
+    Augment::updatePath(*this, parent_node);
     removeFix(parent_node, diff);
+    publishUsage();
+    return node_to_remove;
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff) {
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::removeFix(AVLNode<Key, Value>* node, int diff) {
   if (node == NULL) {
     return;
   }
@@ -284,8 +412,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff) {
   }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removefixLeft(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff) {
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::removefixLeft(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff) {
   if(node->getBalance() + -1 == -2) {
     AVLNode<Key, Value>* newParentNode = node->getLeft();
     if(newParentNode->getBalance() == -1) {
@@ -330,8 +458,8 @@ void AVLTree<Key, Value>::removefixLeft(AVLNode<Key, Value>* node, AVLNode<Key,
   }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removefixRight(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff) {
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::removefixRight(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode, int ndiff) {
   if (node->getBalance() + 1 == 2) {
     AVLNode<Key, Value>* newP = node->getRight();
     if(newP->getBalance() == 1) {
@@ -377,8 +505,8 @@ void AVLTree<Key, Value>::removefixRight(AVLNode<Key, Value>* node, AVLNode<Key,
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::insertFix(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parentNode)
 {
     if (parentNode == NULL || parentNode->getParent() == NULL) {
         return;
@@ -393,8 +521,8 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, AVLNode<Key, Valu
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::fixLeftSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::fixLeftSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
 {
     grand_parentNode->updateBalance(-1);
     if (grand_parentNode->getBalance() == 0) return;
@@ -413,8 +541,8 @@ void AVLTree<Key, Value>::fixLeftSubtree(AVLNode<Key, Value>* grand_parentNode,
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::fixRightSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::fixRightSubtree(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
 {
     grand_parentNode->updateBalance(1);
     if (grand_parentNode->getBalance() == 0) return;
@@ -433,8 +561,8 @@ void AVLTree<Key, Value>::fixRightSubtree(AVLNode<Key, Value>* grand_parentNode,
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::fixLeftRightCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::fixLeftRightCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
 {
     rotateLeft(parentNode);
     rotateRight(grand_parentNode);
@@ -454,8 +582,8 @@ void AVLTree<Key, Value>::fixLeftRightCase(AVLNode<Key, Value>* grand_parentNode
     node->setBalance(0);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::fixRightLeftCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::fixRightLeftCase(AVLNode<Key, Value>* grand_parentNode, AVLNode<Key, Value>* parentNode, AVLNode<Key, Value>* node)
 {
     rotateRight(parentNode);
     rotateLeft(grand_parentNode);
@@ -476,8 +604,8 @@ void AVLTree<Key, Value>::fixRightLeftCase(AVLNode<Key, Value>* grand_parentNode
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node) {
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::rotateLeft(AVLNode<Key, Value>* node) {
   AVLNode<Key, Value>* nR = node->getRight();
   AVLNode<Key, Value>* nL = nR->getLeft();
   AVLNode<Key, Value>* parentNode = node->getParent();
@@ -497,10 +625,12 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node) {
   if (nL != NULL) {
     nL->setParent(node);
   }
+  Augment::update(*this, node);
+  Augment::update(*this, nR);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::rotateRight(AVLNode<Key, Value>* node) {
   AVLNode<Key, Value>* nR = node->getLeft();
   AVLNode<Key, Value>* nL = nR->getRight();
   AVLNode<Key, Value>* parentNode = node->getParent();
@@ -520,10 +650,12 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
   if (nL != NULL) {
     nL->setParent(node);
   }
+  Augment::update(*this, node);
+  Augment::update(*this, nR);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
     BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
@@ -531,5 +663,243 @@ void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>*
     n2->setBalance(tempB);
 }
 
+/**
+ * The stored balance must equal the real height difference of the
+ * subtrees, and that difference must be within the AVL bound.
+ */
+template<class Key, class Value, class Augment>
+bool AVLTree<Key, Value, Augment>::validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    int actual = rightHeight - leftHeight;
+    if (actual < -1 || actual > 1) {
+        return false;
+    }
+    return static_cast<AVLNode<Key, Value>*>(node)->getBalance() == actual;
+}
+
+/**
+ * An AVL tree is always height balanced, and a DSW rebuild would
+ * invalidate the stored balances, so there is nothing to do.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::rebalance()
+{
+
+}
+
+/**
+ * Allocates a node for insert(). Plain AVL trees use AVLNode.
+ */
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value>* AVLTree<Key, Value, Augment>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AVLNode<Key, Value>(key, value, parent);
+}
+
+/**
+ * Moves every node into one freshly allocated block, in depth-first
+ * pre-order, so that a lookup touches the top levels of the tree in a
+ * few adjacent cache lines and an in-order scan mostly walks forward.
+ * The tree stays an ordinary AVLTree: later inserts come from the heap
+ * and removed arena nodes are only destroyed, the block itself being
+ * released once the last of them leaves (or by the next compact()).
+ *
+ * Invalidates all iterators; cursors start again from the root.
+ * Returns the bytes of heap given back, counting allocator headers on
+ * glibc, or 0 if the block is not smaller.
+ */
+template<class Key, class Value, class Augment>
+size_t AVLTree<Key, Value, Augment>::compact()
+{
+    const size_t n = this->size_;
+    if (n == 0) {
+        return 0;
+    }
+
+    std::vector<AVLNode<Key, Value>*> order;
+    order.reserve(n);
+    std::vector<AVLNode<Key, Value>*> stack;
+    stack.push_back(static_cast<AVLNode<Key, Value>*>(this->root_));
+    while (!stack.empty()) {
+        AVLNode<Key, Value>* node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+        if (node->getRight() != nullptr) stack.push_back(node->getRight());
+        if (node->getLeft() != nullptr) stack.push_back(node->getLeft());
+    }
+
+    const size_t stride = nodeBytes();
+    char* block = static_cast<char*>(::operator new(n * stride));
+    size_t before = arena_ != NULL ? this->allocationBytes(arena_, arenaBytes_) : 0;
+
+    // Copy each node into its slot and leave a forwarding pointer to the
+    // copy in the old node's parent field. Copies still hold old links.
+    for (size_t i = 0; i < n; ++i) {
+        AVLNode<Key, Value>* old = order[i];
+        if (!inArena(old)) {
+            before += heapNodeBytes(old);
+        }
+        old->setParent(relocateNode(old, block + i * stride));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        AVLNode<Key, Value>* copy = reinterpret_cast<AVLNode<Key, Value>*>(block + i * stride);
+        Node<Key, Value>* parent = copy->getParent();
+        Node<Key, Value>* left = copy->getLeft();
+        Node<Key, Value>* right = copy->getRight();
+        copy->setParent(parent != nullptr ? parent->getParent() : nullptr);
+        copy->setLeft(left != nullptr ? left->getParent() : nullptr);
+        copy->setRight(right != nullptr ? right->getParent() : nullptr);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (inArena(order[i])) {
+            order[i]->~AVLNode();
+        } else {
+            destroyNode(order[i]);
+        }
+    }
+    ::operator delete(arena_);
+
+    this->root_ = reinterpret_cast<AVLNode<Key, Value>*>(block);
+    arena_ = block;
+    arenaBytes_ = n * stride;
+    arenaLive_ = n;
+    this->relayouts_++;
+
+    size_t after = this->allocationBytes(arena_, arenaBytes_);
+    heapBytes_ = 0;
+    publishUsage();
+    return before > after ? before - after : 0;
+}
+
+template<class Key, class Value, class Augment>
+AVLNode<Key, Value>* AVLTree<Key, Value, Augment>::relocateNode(AVLNode<Key, Value>* node, void* where)
+{
+    return new (where) AVLNode<Key, Value>(*node);
+}
+
+template<class Key, class Value, class Augment>
+size_t AVLTree<Key, Value, Augment>::nodeBytes() const
+{
+    return sizeof(AVLNode<Key, Value>);
+}
+
+template<class Key, class Value, class Augment>
+bool AVLTree<Key, Value, Augment>::inArena(Node<Key, Value>* node) const
+{
+    const char* p = reinterpret_cast<const char*>(node);
+    return arena_ != NULL && !std::less<const char*>()(p, arena_) && std::less<const char*>()(p, arena_ + arenaBytes_);
+}
+
+/**
+ * Nodes from compact() are destroyed in place; everything else was
+ * allocated with new.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::destroyNode(Node<Key, Value>* node)
+{
+    if (!inArena(node)) {
+        delete node;
+        return;
+    }
+    node->~Node();
+    if (--arenaLive_ == 0) {
+        ::operator delete(arena_);
+        arena_ = NULL;
+        arenaBytes_ = 0;
+        publishUsage();
+    }
+}
+
+/**
+ * Every node is gone afterwards, and with them what the registry counts.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::clearHelper(Node<Key, Value>* node)
+{
+    BinarySearchTree<Key, Value>::clearHelper(node);
+    heapBytes_ = 0;
+    registration_.update(0, storageBytes());
+}
+
+/**
+ * Hands this tree's node count and node bytes (as memory_usage() would
+ * count allocatedBytes) to MemoryRegistry.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::publishUsage()
+{
+    registration_.update(this->size_, heapBytes_ + storageBytes());
+}
+
+/**
+ * Moves a node out of the compact() block onto the heap so that a
+ * node_type can delete it.
+ */
+template<class Key, class Value, class Augment>
+Node<Key, Value>* AVLTree<Key, Value, Augment>::releaseNode(Node<Key, Value>* node)
+{
+    if (!inArena(node)) {
+        return node;
+    }
+    AVLNode<Key, Value>* avlNode = static_cast<AVLNode<Key, Value>*>(node);
+    Node<Key, Value>* moved = relocateNode(avlNode, ::operator new(nodeBytes()));
+    destroyNode(node);
+    return moved;
+}
+
+/**
+ * Overwriting a value can change per-subtree data, so refresh the path.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::assignValue(Node<Key, Value>* node, const Value& value)
+{
+    node->setValue(value);
+    Augment::updatePath(*this, static_cast<AVLNode<Key, Value>*>(node));
+}
+
+template<class Key, class Value, class Augment>
+const std::type_info& AVLTree<Key, Value, Augment>::nodeType() const
+{
+    return typeid(AVLNode<Key, Value>);
+}
+
+template<class Key, class Value, class Augment>
+size_t AVLTree<Key, Value, Augment>::balanceBytes() const
+{
+    return sizeof(int8_t);
+}
+
+/**
+ * Nodes in the compact() block are paid for by storageBytes().
+ */
+template<class Key, class Value, class Augment>
+size_t AVLTree<Key, Value, Augment>::heapNodeBytes(Node<Key, Value>* node) const
+{
+    return inArena(node) ? 0 : this->allocationBytes(node, nodeBytes());
+}
+
+template<class Key, class Value, class Augment>
+size_t AVLTree<Key, Value, Augment>::storageBytes() const
+{
+    return arena_ != NULL ? this->allocationBytes(arena_, arenaBytes_) : 0;
+}
+
+/**
+ * A plain AVL tree keeps no per-subtree data.
+ */
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::updateAugment(AVLNode<Key, Value>* node)
+{
+
+}
+
+template<class Key, class Value, class Augment>
+void AVLTree<Key, Value, Augment>::updateAugmentPath(AVLNode<Key, Value>* node)
+{
+
+}
+
+
 
-#endif
\ No newline at end of file
+#endif
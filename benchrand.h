@@ -0,0 +1,18 @@
+#ifndef BENCHRAND_H
+#define BENCHRAND_H
+
+#include <cstdint>
+
+/**
+ * xorshift64: a fast, reproducible stream of keys for the benchmarks.
+ * state must start non-zero.
+ */
+inline uint64_t nextRand(uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+#endif
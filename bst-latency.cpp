@@ -0,0 +1,149 @@
+// Tail-latency harness for BinarySearchTree and AVLTree.
+//
+// Times every insert, find and remove individually, bins the samples into
+// HDR-style histograms (latency.h) and writes percentiles per tree, per
+// operation and per key distribution as JSON. A single long removeFix
+// cascade shows up in p99/p999/max even when the total runtime looks fine.
+//
+//   make bst-latency
+//   ./bst-latency [n] [out.json]
+//
+// Build with DEFS=-DLATENCY_USE_RDTSC to sample with rdtsc instead of
+// steady_clock.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+#include "latency.h"
+
+using namespace std;
+
+// Key orders to insert (and later find/remove) in.
+static vector<uint64_t> makeKeys(const string& dist, uint64_t n, unsigned seed)
+{
+    vector<uint64_t> keys(n);
+    if (dist == "balanced") {
+        // midpoints of [lo, hi) ranges, breadth first: each of 1..n once,
+        // in an order that keeps even an unbalanced BST at log height
+        vector<pair<uint64_t, uint64_t> > ranges;
+        ranges.reserve(n);
+        if (n > 0) {
+            ranges.push_back(make_pair(1, n + 1));
+        }
+        for (size_t next = 0; next < ranges.size(); ++next) {
+            uint64_t lo = ranges[next].first, hi = ranges[next].second;
+            uint64_t mid = lo + (hi - lo) / 2;
+            keys[next] = mid;
+            if (lo < mid) {
+                ranges.push_back(make_pair(lo, mid));
+            }
+            if (mid + 1 < hi) {
+                ranges.push_back(make_pair(mid + 1, hi));
+            }
+        }
+        return keys;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+        keys[i] = i + 1;
+    }
+    if (dist == "random") {
+        srand(seed);
+        for (uint64_t i = n; i > 1; --i) {
+            swap(keys[i - 1], keys[(uint64_t)rand() % i]);
+        }
+    }
+    return keys;
+}
+
+struct OpHistograms
+{
+    LatencyHistogram insert;
+    LatencyHistogram find;
+    LatencyHistogram remove;
+};
+
+template<typename Tree>
+static void runWorkload(const vector<uint64_t>& keys, const LatencyClock& clock, OpHistograms& h)
+{
+    Tree tree;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t start = clock.now();
+        tree.insert(make_pair(keys[i], keys[i]));
+        h.insert.record(clock.toNanos(clock.now() - start));
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t start = clock.now();
+        typename Tree::iterator it = tree.find(keys[i]);
+        h.find.record(clock.toNanos(clock.now() - start));
+        if (it == tree.end()) {
+            cerr << "bst-latency: lost key " << keys[i] << endl;
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t start = clock.now();
+        tree.remove(keys[i]);
+        h.remove.record(clock.toNanos(clock.now() - start));
+    }
+}
+
+static void writeOps(ostream& os, const OpHistograms& h)
+{
+    os << "{\"insert\": ";
+    h.insert.writeJson(os);
+    os << ", \"find\": ";
+    h.find.writeJson(os);
+    os << ", \"remove\": ";
+    h.remove.writeJson(os);
+    os << "}";
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000;
+    const char* outPath = argc > 2 ? argv[2] : NULL;
+    if (n == 0) {
+        cerr << "bst-latency: key count must be at least 1" << endl;
+        return 1;
+    }
+
+    LatencyClock clock;
+    const char* dists[] = { "random", "balanced", "sequential" };
+    const int numDists = sizeof(dists) / sizeof(dists[0]);
+
+    ofstream file;
+    if (outPath != NULL) {
+        file.open(outPath);
+        if (!file) {
+            cerr << "bst-latency: cannot open " << outPath << endl;
+            return 1;
+        }
+    }
+    ostream& os = outPath != NULL ? file : cout;
+
+    os << "{\"n\": " << n << ", \"clock\": \"" << clock.source() << "\", \"unit\": \"ns\", \"results\": [";
+    for (int d = 0; d < numDists; ++d) {
+        vector<uint64_t> keys = makeKeys(dists[d], n, 104);
+
+        OpHistograms bst, avl;
+        runWorkload<BinarySearchTree<uint64_t, uint64_t> >(keys, clock, bst);
+        runWorkload<AVLTree<uint64_t, uint64_t> >(keys, clock, avl);
+
+        os << (d == 0 ? "" : ",") << "\n  {\"distribution\": \"" << dists[d] << "\", \"bst\": ";
+        writeOps(os, bst);
+        os << ",\n   \"avl\": ";
+        writeOps(os, avl);
+        os << "}";
+
+        cerr << dists[d] << ": avl insert p99 " << avl.insert.percentile(99)
+             << "ns, remove p999 " << avl.remove.percentile(99.9) << "ns" << endl;
+    }
+    os << "\n]}\n";
+    return 0;
+}
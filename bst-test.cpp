@@ -1,7 +1,21 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
 #include "bst.h"
 #include "avlbst.h"
+#include "compactavl.h"
+#include "smallavl.h"
+#include "export_bst.h"
+#include "treeviews.h"
+#include "prefixavl.h"
+#include "outoflineavl.h"
+#include "augmentedavl.h"
+#include "checkpointavl.h"
 
 using namespace std;
 
@@ -44,5 +58,452 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Compact AVL Tree Tests
+    AVLMap<char,int> ct;
+    ct.insert(std::make_pair('a',1));
+    ct.insert(std::make_pair('b',2));
+
+    cout << "\nCompactAVLTree contents:" << endl;
+    for(AVLMap<char,int>::iterator it = ct.begin(); it != ct.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(ct.find('b') != ct.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    ct.remove('b');
+    ct.insert(std::make_pair('c',3));
+    ct.insert(std::make_pair('d',4));
+    AVLMap<char,int>::node_type moved = ct.extract('c');
+    ct.erase(ct.find('d'));
+    ct.insert(std::move(moved));
+    ct.compact();
+    cout << "After extract, erase and compact: " << ct.size() << " keys, valid " << ct.validate() << endl;
+
+    // Small AVL Map Tests
+    SmallAVLMap<char,int,4> sm;
+    for(char c = 'a'; c <= 'f'; ++c) {
+        sm.insert(std::make_pair(c, c - 'a'));
+    }
+    cout << "\nSmallAVLMap contents (" << (sm.isInline() ? "inline" : "tree") << "):" << endl;
+    for(SmallAVLMap<char,int,4>::iterator it = sm.begin(); it != sm.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Erasing a through d" << endl;
+    for(char c = 'a'; c <= 'd'; ++c) {
+        sm.remove(c);
+    }
+    cout << "SmallAVLMap is " << (sm.isInline() ? "inline" : "tree") << " with " << sm.size() << " keys" << endl;
+
+    // Export Tests
+    AVLTree<char,int> et;
+    for(char c = 'a'; c <= 'g'; ++c) {
+        et.insert(std::make_pair(c, c - 'a'));
+    }
+    ExportOptions limits;
+    limits.maxDepth = 1;
+    cout << "\nAVLTree export (depth 1):" << endl;
+    exportTree(et, cout, EXPORT_TEXT, limits);
+    exportTree(et, cout, EXPORT_JSON, limits);
+    exportTree(et, cout, EXPORT_JSON_FLAT, limits);
+
+    // Memory Accounting Tests
+    MemoryUsage usage = et.memory_usage();
+    cout << "\nAVLTree memory: " << usage.nodes << " nodes, " << usage.payloadBytes << " payload bytes of "
+         << usage.nodes * usage.nodeBytes << " node bytes" << endl;
+    cout << "Registered AVL trees: " << MemoryRegistry::liveTrees() << endl;
+    size_t registeredBefore = MemoryRegistry::total().nodes;
+    bool registryOk = true;
+    {
+        AVLTree<int,int> rt;
+        for(int i = 0; i < 100; ++i) {
+            rt.insert(std::make_pair(i, i));
+        }
+        rt.compact();
+        for(int i = 0; i < 100; i += 3) {
+            rt.remove(i);
+        }
+        AVLTree<int,int>::node_type nh = rt.extract(1);
+        registryOk = MemoryRegistry::total().nodes == registeredBefore + rt.size();
+        rt.clear();
+        registryOk = registryOk && MemoryRegistry::total().nodes == registeredBefore;
+    }
+    registryOk = registryOk && MemoryRegistry::total().nodes == registeredBefore;
+    cout << "Registry node count matches: " << registryOk << endl;
+    if(!registryOk) {
+        return 1;
+    }
+
+    // Cursor Tests
+    AVLTree<char,int>::cursor cur(et);
+    cout << "\nCursor walk:";
+    for(char c = 'a'; c <= 'i'; c += 2) {
+        AVLTree<char,int>::iterator it = cur.seek(c);
+        cout << " " << c << (it != et.end() ? "+" : "-");
+    }
+    et.remove('c');
+    cur.reset();
+    cur.seek('b');
+    cout << "\nFirst key from c: " << cur.seek_lower('c')->first << endl;
+    et.compact();
+    cout << "After compact: " << (cur.position() == et.end()) << " " << cur.seek('e')->first << endl;
+
+    // Merge and Join View Tests
+    AVLTree<char,int> vt;
+    vt.insert(std::make_pair('b', 20));
+    vt.insert(std::make_pair('z', 30));
+    MergeView<char,int> merged = merge_view(et, vt);
+    cout << "\nMerged keys:";
+    for(MergeView<char,int>::iterator it = merged.begin(); it != merged.end(); ++it) {
+        cout << " " << it->first << it.source();
+    }
+    JoinView<char,int,int> joined = join_view(et, vt);
+    cout << "\nJoined keys:";
+    for(JoinView<char,int,int>::iterator it = joined.begin(); it != joined.end(); ++it) {
+        cout << " " << it.key() << " (" << it.left()->second << ", " << it.right()->second << ")";
+    }
+    cout << endl;
+
+    // Views against std::map: three random trees of very different
+    // densities (the first of each round empty once), merged and joined
+    unsigned viewSeed = 4242;
+    bool viewsOk = true;
+    for(int round = 0; round < 30 && viewsOk; round++) {
+        AVLTree<int,int> viewTrees[3];
+        std::map<int,int> viewBrute[3];
+        const int counts[3] = { round == 0 ? 0 : round * 7, 400, round % 5 };
+        const int spans[3] = { 2000, 1000, 50 };
+        for(int t = 0; t < 3; t++) {
+            for(int i = 0; i < counts[t]; i++) {
+                viewSeed = viewSeed * 1103515245 + 12345;
+                int key = (viewSeed >> 8) % spans[t];
+                viewTrees[t].insert(std::make_pair(key, t * 10000 + i));
+                viewBrute[t][key] = t * 10000 + i;
+            }
+        }
+
+        // a key in several trees comes out once per tree, in add() order
+        std::vector<std::pair<int, std::pair<size_t,int> > > expectedMerge;
+        for(size_t t = 0; t < 3; t++) {
+            for(std::map<int,int>::iterator it = viewBrute[t].begin(); it != viewBrute[t].end(); ++it) {
+                expectedMerge.push_back(std::make_pair(it->first, std::make_pair(t, it->second)));
+            }
+        }
+        std::sort(expectedMerge.begin(), expectedMerge.end());
+        MergeView<int,int> mergedView = merge_view(viewTrees[0], viewTrees[1], viewTrees[2]);
+        size_t m = 0;
+        for(MergeView<int,int>::iterator it = mergedView.begin(); viewsOk && it != mergedView.end(); ++it, ++m) {
+            viewsOk = m < expectedMerge.size() && it->first == expectedMerge[m].first
+                      && it.source() == expectedMerge[m].second.first && it->second == expectedMerge[m].second.second;
+        }
+        viewsOk = viewsOk && m == expectedMerge.size();
+
+        for(int l = 0; l < 3 && viewsOk; l++) {
+            for(int r = 0; r < 3 && viewsOk; r++) {
+                std::map<int,int>::iterator expected = viewBrute[l].begin();
+                JoinView<int,int,int> joinedView = join_view(viewTrees[l], viewTrees[r]);
+                for(JoinView<int,int,int>::iterator it = joinedView.begin(); viewsOk && it != joinedView.end(); ++it, ++expected) {
+                    while(expected != viewBrute[l].end() && viewBrute[r].count(expected->first) == 0) {
+                        ++expected;
+                    }
+                    viewsOk = expected != viewBrute[l].end() && it.key() == expected->first
+                              && it.left()->second == expected->second && it.right()->second == viewBrute[r][expected->first];
+                }
+                while(viewsOk && expected != viewBrute[l].end()) {
+                    viewsOk = viewBrute[r].count(expected->first) == 0;
+                    ++expected;
+                }
+            }
+        }
+    }
+    cout << "Merge and join views match std::map: " << viewsOk << endl;
+    if(!viewsOk) {
+        return 1;
+    }
+
+    // Prefix String Tree Tests
+    PrefixStringTree<int> pt;
+    pt.insert("/usr/share/doc/readme", 1);
+    pt.insert("/usr/share/doc/license", 2);
+    pt.insert("/usr/lib/libc.so", 3);
+    pt["/usr/share/doc"] = 4;
+    pt.remove("/usr/lib/libc.so");
+    cout << "Prefix keys:";
+    for(PrefixStringTree<int>::iterator it = pt.begin(); it != pt.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << "\nFound license: " << (pt.find("/usr/share/doc/license") != pt.end());
+    cout << ", key bytes: " << pt.keyBytes() << endl;
+
+    // Prefix string tree against std::map: shared-prefix paths with enough
+    // removals to make compactKeys() run
+    const char* prefixDirs[] = { "/usr/share/doc/", "/usr/share/man/man3/", "/usr/lib/x86_64-linux-gnu/", "/home/" };
+    PrefixStringTree<int> prefixTree;
+    std::map<std::string,int> prefixBrute;
+    unsigned prefixSeed = 2024;
+    size_t lastKeyBytes = 0;
+    bool prefixCompacted = false;
+    bool prefixOk = true;
+    for(int i = 0; i < 6000 && prefixOk; i++) {
+        prefixSeed = prefixSeed * 1103515245 + 12345;
+        unsigned r = prefixSeed >> 8;
+        std::string key = prefixDirs[r % 4];
+        key += (r >> 2) % 2 ? "package-with-a-long-name-" : "p";
+        key += std::to_string((r >> 3) % 250);
+        // grow for the first third, then mostly remove
+        int op = (r >> 12) % (i < 2000 ? 4 : 10);
+        if(op == 0 || op == 1) {
+            prefixTree.insert(key, i);
+            prefixBrute[key] = i;
+        }
+        else if(op == 2) {
+            prefixTree[key] = i;
+            prefixBrute[key] = i;
+        }
+        else if(op < 6) {
+            prefixTree.remove(key);
+            prefixBrute.erase(key);
+        }
+        else if(op < 9) {
+            PrefixStringTree<int>::iterator it = prefixTree.find(key);
+            if(it != prefixTree.end()) {
+                prefixTree.erase(it);
+            }
+            prefixBrute.erase(key);
+        }
+        else {
+            // erase a run of up to four keys starting at key's successor
+            std::map<std::string,int>::iterator bfirst = prefixBrute.upper_bound(key), blast = bfirst;
+            for(int n = 0; n < 4 && blast != prefixBrute.end(); n++) {
+                ++blast;
+            }
+            if(bfirst != prefixBrute.end()) {
+                PrefixStringTree<int>::iterator first = prefixTree.find(bfirst->first);
+                PrefixStringTree<int>::iterator last = blast == prefixBrute.end() ? prefixTree.end() : prefixTree.find(blast->first);
+                prefixTree.erase(first, last);
+                prefixBrute.erase(bfirst, blast);
+            }
+        }
+        prefixCompacted = prefixCompacted || prefixTree.keyBytes() < lastKeyBytes;
+        lastKeyBytes = prefixTree.keyBytes();
+        prefixOk = prefixTree.size() == prefixBrute.size();
+        if(i % 100 == 99 || !prefixOk) {
+            std::map<std::string,int>::iterator expected = prefixBrute.begin();
+            for(PrefixStringTree<int>::iterator it = prefixTree.begin(); prefixOk && it != prefixTree.end(); ++it, ++expected) {
+                prefixOk = it->first.str() == expected->first && it->second == expected->second
+                           && prefixTree.find(expected->first) == it;
+            }
+            prefixOk = prefixOk && prefixTree.validate() && prefixTree.find(key + "/") == prefixTree.end();
+        }
+    }
+    prefixOk = prefixOk && prefixCompacted;
+    cout << "Prefix tree matches std::map: " << prefixOk << endl;
+    if(!prefixOk) {
+        return 1;
+    }
+
+    // Out-of-line Value Tests
+    OutOfLineAVLTree<int,std::string> ot;
+    ot.insert(std::make_pair(2, std::string("two")));
+    ot.insert(std::make_pair(1, std::string("one")));
+    ot[3] = "three";
+    ot.insert(std::make_pair(2, std::string("deux")));
+    ot.remove(1);
+    cout << "Out-of-line values:";
+    for(OutOfLineAVLTree<int,std::string>::iterator it = ot.begin(); it != ot.end(); ++it) {
+        std::string& value = it->second;
+        cout << " " << it->first << "=" << value;
+    }
+    cout << endl;
+
+    // Out-of-line values against std::map, through every way in: insert,
+    // operator[], assignment through an iterator, remove, erase and compact
+    OutOfLineAVLTree<int,std::string> outTree;
+    std::map<int,std::string> outBrute;
+    unsigned outSeed = 777;
+    bool outOk = true;
+    for(int i = 0; i < 5000 && outOk; i++) {
+        outSeed = outSeed * 1103515245 + 12345;
+        unsigned r = outSeed >> 8;
+        int key = r % 300;
+        // long enough to need a heap buffer half of the time
+        std::string value = std::string((r >> 9) % 2 ? 40 : 3, char('a' + i % 26)) + std::to_string(i);
+        switch((r >> 10) % 8) {
+        case 0:
+        case 1:
+            outTree.insert(std::make_pair(key, value));
+            outBrute[key] = value;
+            break;
+        case 2:
+            outTree[key] = value;
+            outBrute[key] = value;
+            break;
+        case 3: {
+            OutOfLineAVLTree<int,std::string>::iterator it = outTree.find(key);
+            if(it != outTree.end()) {
+                it->second = value;
+                outBrute[key] = value;
+            }
+            break;
+        }
+        case 4:
+        case 5:
+            outTree.remove(key);
+            outBrute.erase(key);
+            break;
+        case 6: {
+            OutOfLineAVLTree<int,std::string>::iterator first = outTree.lower_bound(key);
+            OutOfLineAVLTree<int,std::string>::iterator last = outTree.upper_bound(key + 5);
+            outTree.erase(first, last);
+            outBrute.erase(outBrute.lower_bound(key), outBrute.upper_bound(key + 5));
+            break;
+        }
+        default:
+            if(r % 50 == 0) {
+                outTree.compact();
+            }
+            else {
+                OutOfLineAVLTree<int,std::string>::iterator it = outTree.find(key);
+                if(it != outTree.end()) {
+                    outTree.erase(it);
+                }
+                outBrute.erase(key);
+            }
+        }
+        outOk = outTree.size() == outBrute.size();
+        if(i % 100 == 99 || !outOk) {
+            std::map<int,std::string>::iterator expected = outBrute.begin();
+            for(OutOfLineAVLTree<int,std::string>::iterator it = outTree.begin(); outOk && it != outTree.end(); ++it, ++expected) {
+                const std::string& got = it->second;
+                outOk = it->first == expected->first && got == expected->second;
+            }
+            outOk = outOk && outTree.validate();
+        }
+    }
+    cout << "Out-of-line tree matches std::map: " << outOk << endl;
+    if(!outOk) {
+        return 1;
+    }
+
+    // Augmented AVL Tree Tests: range sum/min/max against a brute force scan
+    AugmentedAVLTree<int,int,SumAggregate<int> > sumTree;
+    AugmentedAVLTree<int,int,MinAggregate<int> > minTree;
+    AugmentedAVLTree<int,int,MaxAggregate<int> > maxTree;
+    std::map<int,int> brute;
+    unsigned seed = 12345;
+    bool aggregatesOk = true;
+    for(int i = 0; i < 2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 8) % 200;
+        int value = (int)((seed >> 4) % 1000) - 500;
+        if((seed >> 20) % 4 == 0) {
+            sumTree.remove(key);
+            minTree.remove(key);
+            maxTree.remove(key);
+            brute.erase(key);
+        }
+        else {
+            sumTree.insert(std::make_pair(key, value));
+            minTree.insert(std::make_pair(key, value));
+            maxTree.insert(std::make_pair(key, value));
+            brute[key] = value;
+        }
+        int lo = (seed >> 12) % 200;
+        int hi = lo + (seed >> 16) % 60;
+        int sum = 0, mn = std::numeric_limits<int>::max(), mx = std::numeric_limits<int>::lowest();
+        for(std::map<int,int>::iterator it = brute.lower_bound(lo); it != brute.end() && it->first <= hi; ++it) {
+            sum += it->second;
+            mn = std::min(mn, it->second);
+            mx = std::max(mx, it->second);
+        }
+        if(sumTree.aggregate(lo, hi) != sum || minTree.aggregate(lo, hi) != mn || maxTree.aggregate(lo, hi) != mx) {
+            aggregatesOk = false;
+        }
+    }
+    aggregatesOk = aggregatesOk && sumTree.validate() && minTree.validate() && maxTree.validate();
+    cout << "Augmented aggregates match: " << aggregatesOk << endl;
+    if(!aggregatesOk) {
+        return 1;
+    }
+
+    // Checkpoint Tests: base, deltas and restore against a std::map, then
+    // a second store on the same directory
+    char ckptDir[] = "/tmp/bst-test-ckpt-XXXXXX";
+    bool checkpointOk = mkdtemp(ckptDir) != NULL;
+    if(checkpointOk) {
+        CheckpointStore store(ckptDir);
+        CheckpointedAVLTree<int,int> ckpt;
+        std::map<int,int> saved;
+        size_t deltas = 0;
+        for(int round = 0; round < 10 && checkpointOk; round++) {
+            for(int i = 0; i < 300; i++) {
+                seed = seed * 1103515245 + 12345;
+                int key = (seed >> 8) % 400;
+                if((seed >> 20) % 3 == 0) {
+                    ckpt.remove(key);
+                    saved.erase(key);
+                }
+                else {
+                    ckpt.insert(std::make_pair(key, round));
+                    saved[key] = round;
+                }
+            }
+            deltas += ckpt.checkpoint(store).full ? 0 : 1;
+            CheckpointedAVLTree<int,int> restored;
+            restored.restore(store);
+            checkpointOk = restored.size() == saved.size() && ckpt.size() == saved.size() && restored.validate();
+            std::map<int,int>::iterator expected = saved.begin();
+            for(CheckpointedAVLTree<int,int>::iterator it = restored.begin(); checkpointOk && it != restored.end(); ++it, ++expected) {
+                checkpointOk = it->first == expected->first && it->second == expected->second;
+            }
+        }
+        checkpointOk = checkpointOk && deltas > 0;
+
+        // The other store writes after ckpt's last checkpoint: it must
+        // see that and write a base, and ckpt's next write must too.
+        CheckpointStore other(ckptDir);
+        CheckpointedAVLTree<int,int> rival;
+        rival.restore(other);
+        rival.insert(std::make_pair(1000, 1));
+        ckpt.insert(std::make_pair(1001, 1));
+        checkpointOk = checkpointOk && !ckpt.checkpoint(store).full && rival.checkpoint(other).full;
+        CheckpointedAVLTree<int,int> restored;
+        restored.restore(store);
+        checkpointOk = checkpointOk && restored.size() == saved.size() + 1 && restored.find(1000) != restored.end()
+                       && restored.find(1001) == restored.end() && ckpt.checkpoint(store).full;
+
+        // Two stores that read the same MANIFEST: distinct files, and only
+        // the first commit wins.
+        CheckpointStore first(ckptDir);
+        CheckpointStore second(ckptDir);
+        std::string firstName = first.nextFile("base");
+        std::string secondName = second.nextFile("base");
+        checkpointOk = checkpointOk && firstName != secondName;
+        first.commitDelta(firstName, 0);
+        bool lost = false;
+        try {
+            second.commitDelta(secondName, 0);
+        }
+        catch(const std::runtime_error&) {
+            lost = true;
+        }
+        checkpointOk = checkpointOk && lost;
+
+        for(size_t i = 0; i < first.files().size(); i++) {
+            std::remove(first.path(first.files()[i]).c_str());
+        }
+        std::remove(first.path(secondName).c_str());
+        std::remove(first.path("MANIFEST").c_str());
+        std::remove(first.path("LOCK").c_str());
+        rmdir(ckptDir);
+    }
+    cout << "Checkpoint round trips match: " << checkpointOk << endl;
+    if(!checkpointOk) {
+        return 1;
+    }
+
     return 0;
 }
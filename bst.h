@@ -5,6 +5,23 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <typeinfo>
+#include <type_traits>
+#include "memusage.h"
+#include "trace.h"
+
+// Number of lookups find_many() keeps in flight at once.
+#define BST_FIND_MANY_INFLIGHT 16
+
+#if defined(__GNUC__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BST_PREFETCH(p) ((void)(p))
+#endif
 
 /**
  * A templated class for a Node in a search tree.
@@ -186,6 +203,11 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+template <typename Key, typename Value>
+class ParallelTraversal;
+template <typename Key, typename Value>
+class ExportWalk;
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -195,15 +217,32 @@ class BinarySearchTree
 public:
     BinarySearchTree(); //TODO
     virtual ~BinarySearchTree(); //TODO
-    virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    class iterator;
+    class node_type;
+    virtual std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    std::pair<iterator, bool> insert(node_type&& handle);
+    std::pair<iterator, bool> insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
     virtual void remove(const Key& key); //TODO
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    bool validate() const;
     void print() const;
     bool empty() const;
+    size_t size() const;
+    MemoryUsage memory_usage(bool countPages = false) const;
+    void setRecorder(TraceRecorder* recorder);
+    TraceRecorder* recorder() const;
+    virtual void rebalance();
+    void setScapegoat(double alpha);
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    friend class ParallelTraversal<Key, Value>;
+    friend class ExportWalk<Key, Value>;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -227,16 +266,91 @@ public:
         Node<Key, Value> *current_;
     };
 
+    /**
+    * Owns a node taken out of a tree by extract(), so that it can be
+    * moved into another tree by insert() without reallocating.
+    * Move-only; frees the node if it is never re-inserted.
+    */
+    class node_type
+    {
+    public:
+        node_type();
+        node_type(node_type&& other);
+        node_type& operator=(node_type&& other);
+        ~node_type();
+
+        bool empty() const;
+        explicit operator bool() const;
+        const Key& key() const;
+        Value& mapped() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value>;
+        explicit node_type(Node<Key, Value>* node);
+        Node<Key, Value>* node_;
+    };
+
+    /**
+    * Remembers where the last lookup ended so that the next one starts
+    * there (see find(hint, key)) instead of at the root. For runs of
+    * nearby keys a seek costs about the log of the rank distance d to the
+    * previous position: it climbs only to the lowest ancestor whose
+    * subtree must hold the key. A single seek may still climb to the root
+    * when the two keys straddle it, so the O(log d) cost holds on average
+    * over a run rather than for every seek.
+    *
+    * A miss leaves the cursor on a neighbour of the key, so misses keep
+    * the finger close too. Inserts and rotations are safe, and so are
+    * clear() and AVLTree::compact(), which free or move every node: the
+    * next seek notices and starts from the root. Taking out the node the
+    * cursor rests on, by remove(), erase() or extract(), is not safe, so
+    * reset() after that.
+    */
+    class cursor
+    {
+    public:
+        explicit cursor(const BinarySearchTree<Key, Value>& tree);
+
+        iterator seek(const Key& key);
+        iterator seek_lower(const Key& key);
+        iterator position() const;
+        void reset();
+
+    protected:
+        Node<Key, Value>* locate(const Key& key, Node<Key, Value>*& parent, bool& left);
+
+        const BinarySearchTree<Key, Value>* tree_;
+        Node<Key, Value>* finger_;
+        size_t relayouts_;  // the tree's relayouts_ when finger_ was set
+    };
+
 public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    iterator find(iterator hint, const Key& key) const;
+    void find_many(const Key* keys, size_t count, iterator* out) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    template<typename Factory>
+    std::pair<iterator, bool> find_or_insert(const Key& key, Factory factory);
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* locate(const Key& key, Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* locateFrom(Node<Key, Value>* hint, const Key& key, Node<Key, Value>*& parent, bool& left) const;
+    virtual void assignValue(Node<Key, Value>* node, const Value& value);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* parent, bool left, const Key& key, const Value& value);
+    virtual Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node);
+    virtual Node<Key, Value>* unlinkNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* releaseNode(Node<Key, Value>* node);
+    virtual const std::type_info& nodeType() const;
+    virtual bool canAdopt(Node<Key, Value>* node) const;
+    void removeNode(Node<Key, Value>* node);
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
@@ -248,11 +362,40 @@ protected:
 
     // Add helper functions here
     virtual void clearHelper(Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    // memory_usage() hooks: nodeBytes() is the size of the tree's node
+    // type and balanceBytes() the part of it holding balance data;
+    // heapNodeBytes() is what one individually allocated node costs (0
+    // for nodes in bulk storage) and storageBytes() the bulk storage
+    // (arenas, pools); auxiliaryBytes() is anything else the tree owns.
+    virtual size_t nodeBytes() const;
+    virtual size_t balanceBytes() const;
+    virtual size_t heapNodeBytes(Node<Key, Value>* node) const;
+    virtual size_t storageBytes() const;
+    virtual size_t auxiliaryBytes() const;
+    static size_t allocationBytes(void* ptr, size_t size);
     virtual std::pair<bool, int> checkBalance(Node<Key, Value>* node) const;
+    virtual bool validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const;
+    static iterator iteratorFor(Node<Key, Value>* node);
+    void pivotLeft(Node<Key, Value>* node);
+    void pivotRight(Node<Key, Value>* node);
+    void rebuildSubtree(Node<Key, Value>* node);
+    void compressVine(Node<Key, Value>* parent, bool left, size_t count);
+    static size_t subtreeSize(Node<Key, Value>* node);
+    void traceOp(uint8_t op, const Key& key) const;
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    size_t size_;
+    // Scapegoat mode (off when alpha_ is 0): largest size since the last
+    // full rebuild, and the weight-balance factor.
+    size_t maxSize_;
+    double alpha_;
+    // Receives every operation while set; see setRecorder().
+    TraceRecorder* recorder_;
+    // Counts the calls that freed or moved every node, so that cursors
+    // can tell their finger is gone.
+    size_t relayouts_;
 };
 
 /*
@@ -357,6 +500,150 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type() : node_(NULL)
+{
+
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type(Node<Key, Value>* node) : node_(node)
+{
+
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::node_type(node_type&& other) : node_(other.node_)
+{
+    other.node_ = NULL;
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::node_type&
+BinarySearchTree<Key, Value>::node_type::operator=(node_type&& other)
+{
+    if (this != &other) {
+        delete node_;
+        node_ = other.node_;
+        other.node_ = NULL;
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::~node_type()
+{
+    delete node_;
+}
+
+template<class Key, class Value>
+bool BinarySearchTree<Key, Value>::node_type::empty() const
+{
+    return node_ == NULL;
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::node_type::operator bool() const
+{
+    return node_ != NULL;
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+const Key& BinarySearchTree<Key, Value>::node_type::key() const
+{
+    return node_->getKey();
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+Value& BinarySearchTree<Key, Value>::node_type::mapped() const
+{
+    return node_->getValue();
+}
+
+template<class Key, class Value>
+BinarySearchTree<Key, Value>::cursor::cursor(const BinarySearchTree<Key, Value>& tree) :
+    tree_(&tree), finger_(NULL), relayouts_(tree.relayouts_)
+{
+
+}
+
+/**
+* Searches from the finger (the root on first use) and moves the finger
+* to where the search ended.
+*/
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::cursor::locate(const Key& key, Node<Key, Value>*& parent, bool& left)
+{
+    if (relayouts_ != tree_->relayouts_) {
+        finger_ = NULL;
+        relayouts_ = tree_->relayouts_;
+    }
+    Node<Key, Value>* found = tree_->locateFrom(finger_, key, parent, left);
+    finger_ = found != NULL ? found : parent;
+    return found;
+}
+
+/**
+* Returns an iterator to key, or end() if it is absent.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::cursor::seek(const Key& key)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    return iterator(locate(key, parent, left));
+}
+
+/**
+* Returns an iterator to the first key not less than key, or end().
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::cursor::seek_lower(const Key& key)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* found = locate(key, parent, left);
+    if (found != NULL || parent == NULL) {
+        return iterator(found);
+    }
+    // key would hang below parent, so parent is its predecessor or successor
+    iterator it(parent);
+    if (!left) {
+        ++it;
+    }
+    return it;
+}
+
+/**
+* The node the last seek ended on: the key's node, or a neighbour of the
+* key if it was absent. end() before the first seek, and after clear()
+* or compact().
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::cursor::position() const
+{
+    return iterator(relayouts_ == tree_->relayouts_ ? finger_ : NULL);
+}
+
+/**
+* Forgets the finger; the next seek starts at the root.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::cursor::reset()
+{
+    finger_ = NULL;
+}
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -370,6 +657,11 @@ template<class Key, class Value>
 BinarySearchTree<Key, Value>::BinarySearchTree()
 {
     this->root_ = (NULL);
+    this->size_ = 0;
+    this->maxSize_ = 0;
+    this->alpha_ = 0;
+    this->recorder_ = NULL;
+    this->relayouts_ = 0;
 }
 
 template<typename Key, typename Value>
@@ -379,6 +671,15 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 
 }
 
+/**
+ * Returns the number of keys in the tree
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return size_;
+}
+
 /**
  * Returns true if tree is empty
 */
@@ -388,6 +689,79 @@ bool BinarySearchTree<Key, Value>::empty() const
     return root_ == NULL;
 }
 
+/**
+ * Breaks down the tree's footprint. Visits every node; with countPages
+ * it also sorts their page numbers, so keep it off hot paths.
+ */
+template<class Key, class Value>
+MemoryUsage BinarySearchTree<Key, Value>::memory_usage(bool countPages) const
+{
+    MemoryUsage usage;
+    usage.nodes = size_;
+    usage.nodeBytes = nodeBytes();
+    usage.payloadBytes = size_ * sizeof(std::pair<const Key, Value>);
+    usage.pointerBytes = size_ * 3 * sizeof(Node<Key, Value>*);
+    usage.vptrBytes = std::is_polymorphic<Node<Key, Value> >::value ? size_ * sizeof(void*) : 0;
+    usage.balanceBytes = size_ * balanceBytes();
+    usage.paddingBytes = size_ * usage.nodeBytes - usage.payloadBytes - usage.pointerBytes
+                         - usage.vptrBytes - usage.balanceBytes;
+
+    std::vector<uintptr_t> pages;
+    usage.allocatedBytes = storageBytes();
+    // not begin(), which a trace would log as a scan
+    for (iterator it(getSmallestNode()); it != end(); ++it) {
+        usage.allocatedBytes += heapNodeBytes(it.current_);
+        if (countPages) {
+            uintptr_t first = reinterpret_cast<uintptr_t>(it.current_);
+            pages.push_back(first / MEMUSAGE_PAGE_BYTES);
+            pages.push_back((first + usage.nodeBytes - 1) / MEMUSAGE_PAGE_BYTES);
+        }
+    }
+    size_t live = size_ * usage.nodeBytes;
+    usage.slackBytes = usage.allocatedBytes > live ? usage.allocatedBytes - live : 0;
+    usage.auxiliaryBytes = auxiliaryBytes();
+    if (countPages) {
+        std::sort(pages.begin(), pages.end());
+        usage.pagesSpanned = std::unique(pages.begin(), pages.end()) - pages.begin();
+    }
+    return usage;
+}
+
+/**
+ * Starts logging every insert, find, remove and scan start to recorder
+ * (see trace.h), or stops when recorder is NULL. The keys already in the
+ * tree are logged first as TRACE_PRELOAD inserts so that a replay starts
+ * from the same contents. The recorder must outlive its use here.
+ */
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setRecorder(TraceRecorder* recorder)
+{
+    recorder_ = recorder;
+    if (recorder_ == NULL) {
+        return;
+    }
+    for (iterator it(getSmallestNode()); it != end(); ++it) {
+        recorder_->record(TRACE_INSERT | TRACE_PRELOAD, TraceKeyHash<Key>()(it->first));
+    }
+}
+
+template<typename Key, typename Value>
+TraceRecorder* BinarySearchTree<Key, Value>::recorder() const
+{
+    return recorder_;
+}
+
+/**
+ * Costs one test of recorder_ when tracing is off.
+ */
+template<typename Key, typename Value>
+inline void BinarySearchTree<Key, Value>::traceOp(uint8_t op, const Key& key) const
+{
+    if (recorder_ != NULL) {
+        recorder_->record(op, TraceKeyHash<Key>()(key));
+    }
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::print() const
 {
@@ -402,6 +776,9 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::begin() const
 {
+    if (recorder_ != NULL) {
+        recorder_->record(TRACE_ITERATE | TRACE_FROM_START, 0);
+    }
     BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
     return begin;
 }
@@ -425,64 +802,398 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::find(const Key & k) const
 {
+    traceOp(TRACE_FIND, k);
     Node<Key, Value> *curr = internalFind(k);
     BinarySearchTree<Key, Value>::iterator it(curr);
     return it;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
+ * Looks up count keys at once, writing find(keys[i]) to out[i].
+ *
+ * Keeps BST_FIND_MANY_INFLIGHT searches in flight and advances them
+ * round-robin, one level each. Every search prefetches its next child
+ * before the others take their step, so by the time it is dereferenced
+ * the cache miss has overlapped with the other searches' work. A slot
+ * whose search finishes immediately starts the next key.
+ */
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::find_many(const Key* keys, size_t count, iterator* out) const
+{
+    for (size_t i = 0; recorder_ != NULL && i < count; ++i) {
+        traceOp(TRACE_FIND, keys[i]);
+    }
+    if (root_ == NULL) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = end();
+        }
+        return;
+    }
+
+    Node<Key, Value>* nodes[BST_FIND_MANY_INFLIGHT];
+    size_t index[BST_FIND_MANY_INFLIGHT];
+    size_t slots = 0;
+    size_t next = 0;
+    while (slots < BST_FIND_MANY_INFLIGHT && next < count) {
+        nodes[slots] = root_;
+        index[slots++] = next++;
+    }
+
+    size_t active = slots;
+    while (active > 0) {
+        for (size_t s = 0; s < slots; ++s) {
+            Node<Key, Value>* n = nodes[s];
+            if (n == NULL) {
+                continue;   // retired slot
+            }
+            const Key& k = keys[index[s]];
+            Node<Key, Value>* child;
+            if (k < n->getKey()) {
+                child = n->getLeft();
+            } else if (k > n->getKey()) {
+                child = n->getRight();
+            } else {
+                out[index[s]] = iterator(n);
+                child = NULL;
+                n = NULL;
+            }
+
+            if (child != NULL) {
+                BST_PREFETCH(child);
+                nodes[s] = child;
+                continue;
+            }
+            if (n != NULL) {
+                out[index[s]] = end();   // fell off a leaf: miss
+            }
+            if (next < count) {
+                nodes[s] = root_;
+                index[s] = next++;
+            } else {
+                nodes[s] = NULL;
+                active--;
+            }
+        }
+    }
+}
+
+/**
+ * Vector form of find_many(); out is resized to keys.size().
+ */
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.resize(keys.size());
+    if (!keys.empty()) {
+        find_many(&keys[0], keys.size(), &out[0]);
+    }
+}
+
+/**
+ * Returns an iterator to the first key not less than key, or end().
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lower_bound(const Key& key) const
+{
+    traceOp(TRACE_ITERATE, key);
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = NULL;
+    while (current != NULL) {
+        if (current->getKey() < key) {
+            current = current->getRight();
+        } else {
+            bound = current;
+            current = current->getLeft();
+        }
+    }
+    return iterator(bound);
+}
+
+/**
+ * Returns an iterator to the first key greater than key, or end().
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::upper_bound(const Key& key) const
+{
+    traceOp(TRACE_ITERATE, key);
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = NULL;
+    while (current != NULL) {
+        if (key < current->getKey()) {
+            bound = current;
+            current = current->getLeft();
+        } else {
+            current = current->getRight();
+        }
+    }
+    return iterator(bound);
+}
+
+/**
+ * Returns the value associated with the key, inserting a
+ * default-constructed value first if the key is missing (as std::map
+ * does). Takes a single descent either way.
  */
 template<class Key, class Value>
 Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* curr = locate(key, parent, left);
+    traceOp(curr == NULL ? TRACE_INSERT : TRACE_FIND, key);
+    if(curr == NULL) curr = attachNode(parent, left, key, Value());
     return curr->getValue();
 }
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
 template<class Key, class Value>
 Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 {
+    traceOp(TRACE_FIND, key);
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
 
+/**
+ * Wraps a node in an iterator. Lets derived trees hand out iterators
+ * from their own searches.
+ */
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iteratorFor(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
 /**
 * An insert method to insert into a Binary Search Tree.
 * The tree will not remain balanced when inserting.
 * Recall: If key is already in the tree, you should 
 * overwrite the current value with the updated value.
+*
+* Returns an iterator to the key's node and true if a node was created,
+* or false if an existing value was overwritten.
 */
 template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-    if (!root_) {
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
-        return;
+    traceOp(TRACE_INSERT, keyValuePair.first);
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* existing = locate(keyValuePair.first, parent, left);
+    if (existing != NULL) {
+        existing->setValue(keyValuePair.second);
+        return std::make_pair(iterator(existing), false);
     }
+    Node<Key, Value>* node = attachNode(parent, left, keyValuePair.first, keyValuePair.second);
+    return std::make_pair(iterator(node), true);
+}
 
+/**
+* insert() that starts its search at hint rather than at the root. When
+* keys arrive in or near sorted order, passing the previous result as
+* the hint makes each search cost about the log of the distance between
+* neighbouring keys instead of the height of the tree.
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    traceOp(TRACE_INSERT, keyValuePair.first);
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* existing = locateFrom(hint.current_, keyValuePair.first, parent, left);
+    if (existing != NULL) {
+        assignValue(existing, keyValuePair.second);
+        return std::make_pair(iterator(existing), false);
+    }
+    Node<Key, Value>* node = attachNode(parent, left, keyValuePair.first, keyValuePair.second);
+    return std::make_pair(iterator(node), true);
+}
+
+/**
+* find() that starts its search at hint; see insert(hint, item).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(iterator hint, const Key& key) const
+{
+    traceOp(TRACE_FIND, key);
+    Node<Key, Value>* parent;
+    bool left;
+    return iterator(locateFrom(hint.current_, key, parent, left));
+}
+
+/**
+* Overwrites the value of a node already in the tree. Trees that keep
+* per-subtree data override this to refresh it.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::assignValue(Node<Key, Value>* node, const Value& value)
+{
+    node->setValue(value);
+}
+
+/**
+* Returns an iterator to the key's node and false if the key is present.
+* Otherwise inserts factory() under the key and returns true. The factory
+* is only called when a node is created, and the tree is descended once.
+*/
+template<class Key, class Value>
+template<typename Factory>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::find_or_insert(const Key& key, Factory factory)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* existing = locate(key, parent, left);
+    traceOp(existing == NULL ? TRACE_INSERT : TRACE_FIND, key);
+    if (existing != NULL) {
+        return std::make_pair(iterator(existing), false);
+    }
+    return std::make_pair(iterator(attachNode(parent, left, key, factory())), true);
+}
+
+/**
+* Single descent shared by insert(), operator[] and find_or_insert().
+* Returns the node holding key, or NULL with parent/left set to where a
+* new node for key would hang (parent is NULL for an empty tree).
+*/
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::locate(const Key& key, Node<Key, Value>*& parent, bool& left) const
+{
     Node<Key, Value>* current = root_;
-    Node<Key, Value>* parent = NULL;
+    parent = NULL;
+    left = false;
+    while (current != NULL) {
+        if (key < current->getKey()) {
+            parent = current;
+            left = true;
+            current = current->getLeft();
+        } else if (key > current->getKey()) {
+            parent = current;
+            left = false;
+            current = current->getRight();
+        } else {
+            return current;
+        }
+    }
+    return NULL;
+}
 
+/**
+* locate() starting from hint (the root if hint is NULL). Climbs only as
+* far as the lowest ancestor whose subtree must hold key: for a key
+* above hint's, the first one entered from a left child whose key is
+* above key (symmetrically for a smaller key), then descends from there.
+*/
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::locateFrom(Node<Key, Value>* hint, const Key& key, Node<Key, Value>*& parent, bool& left) const
+{
+    if (hint == NULL) {
+        return locate(key, parent, left);
+    }
+    bool up = hint->getKey() < key;
+    if (!up && !(key < hint->getKey())) {
+        parent = hint->getParent();
+        left = (parent != NULL && parent->getLeft() == hint);
+        return hint;
+    }
+    Node<Key, Value>* current = hint;
+    Node<Key, Value>* p = current->getParent();
+    while (p != NULL) {
+        if (up ? (p->getLeft() == current && key < p->getKey())
+               : (p->getRight() == current && p->getKey() < key)) {
+            break;
+        }
+        current = p;
+        p = current->getParent();
+    }
+
+    // key can only be in current's subtree (or hang below it)
+    parent = p;
+    left = (p != NULL && p->getLeft() == current);
     while (current != NULL) {
-        parent = current;
-        if (keyValuePair.first < current->getKey()) {
+        if (key < current->getKey()) {
+            parent = current;
+            left = true;
             current = current->getLeft();
-        } else if (keyValuePair.first > current->getKey()) {
+        } else if (current->getKey() < key) {
+            parent = current;
+            left = false;
             current = current->getRight();
         } else {
-            current->setValue(keyValuePair.second);
-            return;
+            return current;
         }
     }
+    return NULL;
+}
 
-    if (keyValuePair.first < parent->getKey()) {
-        parent->setLeft(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+/**
+* Creates a node for key under parent (as its left or right child, or as
+* the root when parent is NULL) and returns it. Balanced trees override
+* this to allocate their own node type.
+*/
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::attachNode(Node<Key, Value>* parent, bool left, const Key& key, const Value& value)
+{
+    return linkNode(parent, left, new Node<Key, Value>(key, value, parent));
+}
+
+/**
+* Hangs an allocated node of nodeType() under parent as a leaf and
+* returns it. Balanced trees override this to rebalance after linking.
+*/
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node)
+{
+    node->setParent(parent);
+    node->setLeft(NULL);
+    node->setRight(NULL);
+    if (parent == NULL) {
+        root_ = node;
+    } else if (left) {
+        parent->setLeft(node);
     } else {
-        parent->setRight(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+        parent->setRight(node);
     }
+    size_++;
+
+    if (alpha_ > 0) {
+        maxSize_ = std::max(maxSize_, size_);
+        size_t depth = 0;
+        for (Node<Key, Value>* p = parent; p != NULL; p = p->getParent()) {
+            depth++;
+        }
+        // too deep for an alpha-weight-balanced tree: some ancestor has a
+        // child holding more than alpha of its weight, so rebuild there
+        if (depth > std::log((double)size_) / std::log(1.0 / alpha_)) {
+            Node<Key, Value>* child = node;
+            size_t childSize = 1;
+            for (Node<Key, Value>* p = parent; p != NULL; p = p->getParent()) {
+                Node<Key, Value>* sibling = (p->getLeft() == child) ? p->getRight() : p->getLeft();
+                size_t pSize = childSize + subtreeSize(sibling) + 1;
+                if ((double)childSize > alpha_ * (double)pSize) {
+                    rebuildSubtree(p);
+                    break;
+                }
+                child = p;
+                childSize = pSize;
+            }
+        }
+    }
+    return node;
 }
 
 
@@ -494,9 +1205,28 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key) 
 {
+    traceOp(TRACE_REMOVE, key);
     Node<Key, Value>* target = internalFind(key);
     if (!target) return; 
+    removeNode(target);
+}
 
+/**
+* Unlinks and frees a node already known to be in the tree.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* node)
+{
+    destroyNode(unlinkNode(node));
+}
+
+/**
+* Takes target out of the tree without freeing it and returns it; its
+* own links are left stale. Balanced trees override this to rebalance.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::unlinkNode(Node<Key, Value>* target)
+{
 
     if (target->getLeft() && target->getRight()) {
         Node<Key, Value>* pred = predecessor(target);
@@ -528,7 +1258,129 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         }
     }
 
-    delete target;
+    size_--;
+
+    if (alpha_ > 0 && (double)size_ < alpha_ * (double)maxSize_) {
+        rebalance();
+    }
+    return target;
+}
+
+/**
+* Removes the node at pos, which must be valid, and returns an iterator
+* to the key after it. Does not search; other iterators stay valid.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos)
+{
+    traceOp(TRACE_REMOVE, pos->first);
+    iterator next = pos;
+    ++next;
+    removeNode(pos.current_);
+    return next;
+}
+
+/**
+* Removes every key in [first, last) and returns last. Each removal
+* starts from the node itself, so there are no searches, but each one
+* still unlinks and retraces on its own: O(k log n) for k keys in all.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator first, iterator last)
+{
+    while (first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+/**
+* Takes the key's node out of the tree and hands over ownership, or
+* returns an empty handle if the key is missing.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::node_type
+BinarySearchTree<Key, Value>::extract(const Key& key)
+{
+    traceOp(TRACE_REMOVE, key);
+    Node<Key, Value>* node = internalFind(key);
+    if (node == NULL) {
+        return node_type();
+    }
+    return node_type(releaseNode(unlinkNode(node)));
+}
+
+/**
+* Takes the node at pos, which must be valid, out of the tree.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::node_type
+BinarySearchTree<Key, Value>::extract(iterator pos)
+{
+    traceOp(TRACE_REMOVE, pos->first);
+    return node_type(releaseNode(unlinkNode(pos.current_)));
+}
+
+/**
+* Inserts an extracted node. If the key is already present nothing
+* changes and the handle keeps its node. A node the tree can adopt
+* (see canAdopt()) is linked in as is; any other has its item copied
+* into a new node instead.
+*/
+template<typename Key, typename Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert(node_type&& handle)
+{
+    if (handle.empty()) {
+        return std::make_pair(end(), false);
+    }
+    traceOp(TRACE_INSERT, handle.key());
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* existing = locate(handle.key(), parent, left);
+    if (existing != NULL) {
+        return std::make_pair(iterator(existing), false);
+    }
+    Node<Key, Value>* node = handle.node_;
+    handle.node_ = NULL;
+    if (canAdopt(node)) {
+        return std::make_pair(iterator(linkNode(parent, left, node)), true);
+    }
+    Node<Key, Value>* copy = attachNode(parent, left, node->getKey(), node->getValue());
+    delete node;
+    return std::make_pair(iterator(copy), true);
+}
+
+/**
+* Turns an unlinked node into one that node_type can own and delete.
+* Trees that place nodes outside the heap override this.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::releaseNode(Node<Key, Value>* node)
+{
+    return node;
+}
+
+/**
+* The dynamic type of the nodes this tree allocates.
+*/
+template<typename Key, typename Value>
+const std::type_info& BinarySearchTree<Key, Value>::nodeType() const
+{
+    return typeid(Node<Key, Value>);
+}
+
+/**
+* Whether insert(node_type&&) may link a released heap node in as is:
+* by default, if it is of nodeType(). Trees that keep their nodes
+* somewhere else override this.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::canAdopt(Node<Key, Value>* node) const
+{
+    return typeid(*node) == nodeType();
 }
 
 
@@ -564,14 +1416,225 @@ void BinarySearchTree<Key, Value>::clear()
 {
     clearHelper(root_);
     root_ = NULL;
+    size_ = 0;
+    maxSize_ = 0;
+    relayouts_++;
 }
 
+/**
+* Deletes the subtree at node in post-order. Walks with the parent
+* pointers instead of recursing, so degenerate trees cannot overflow
+* the stack.
+*/
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node) {
-    if (node != NULL) {
-        clearHelper(node->getLeft());  
-        clearHelper(node->getRight()); 
-        delete node; 
+    Node<Key, Value>* current = node;
+    while (current != NULL) {
+        if (current->getLeft() != NULL) {
+            current = current->getLeft();
+        } else if (current->getRight() != NULL) {
+            current = current->getRight();
+        } else {
+            Node<Key, Value>* parent = current->getParent();
+            if (current == node) {
+                parent = NULL;
+            } else if (parent->getLeft() == current) {
+                parent->setLeft(NULL);
+            } else {
+                parent->setRight(NULL);
+            }
+            destroyNode(current);
+            current = parent;
+        }
+    }
+}
+
+/**
+* Frees a node that has already been unlinked. Trees that place nodes
+* somewhere other than the heap override this.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
+    delete node;
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::nodeBytes() const
+{
+    return sizeof(Node<Key, Value>);
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::balanceBytes() const
+{
+    return 0;
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::heapNodeBytes(Node<Key, Value>* node) const
+{
+    return allocationBytes(node, nodeBytes());
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::storageBytes() const
+{
+    return 0;
+}
+
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::auxiliaryBytes() const
+{
+    return 0;
+}
+
+/**
+ * Heap footprint of an allocation of size bytes at ptr, including the
+ * allocator's header where it can be queried.
+ */
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::allocationBytes(void* ptr, size_t size)
+{
+#if defined(__GLIBC__)
+    return malloc_usable_size(ptr) + sizeof(size_t);
+#else
+    (void)ptr;
+    return (size + sizeof(size_t) + 15) & ~(size_t)15;
+#endif
+}
+
+/**
+* Rebuilds the whole tree into a complete tree with Day-Stout-Warren:
+* O(n) time, O(1) extra space, no per-node bookkeeping.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+    if (root_ != NULL) {
+        rebuildSubtree(root_);
+    }
+    maxSize_ = size_;
+}
+
+/**
+* Turns on scapegoat mode for an alpha in (0.5, 1); 0 turns it off.
+* Inserting deeper than log base 1/alpha of the size rebuilds the
+* smallest subtree that is out of alpha-weight balance. Once removals
+* leave fewer than alpha * (largest size seen) keys, the whole tree is
+* rebuilt. Lower alpha keeps the tree shallower but rebuilds more often.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setScapegoat(double alpha)
+{
+    alpha_ = (alpha > 0.5 && alpha < 1.0) ? alpha : 0;
+    maxSize_ = size_;
+}
+
+/**
+* Number of nodes in the subtree at node, counted iteratively.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::subtreeSize(Node<Key, Value>* node)
+{
+    size_t count = 0;
+    std::vector<Node<Key, Value>*> stack;
+    if (node != NULL) stack.push_back(node);
+    while (!stack.empty()) {
+        Node<Key, Value>* n = stack.back();
+        stack.pop_back();
+        count++;
+        if (n->getLeft() != NULL) stack.push_back(n->getLeft());
+        if (n->getRight() != NULL) stack.push_back(n->getRight());
+    }
+    return count;
+}
+
+/**
+* A plain left rotation at node (its right child takes its place), with
+* no balance bookkeeping.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::pivotLeft(Node<Key, Value>* node)
+{
+    Node<Key, Value>* r = node->getRight();
+    Node<Key, Value>* parent = node->getParent();
+    node->setRight(r->getLeft());
+    if (r->getLeft() != NULL) r->getLeft()->setParent(node);
+    r->setLeft(node);
+    r->setParent(parent);
+    node->setParent(r);
+    if (parent == NULL) root_ = r;
+    else if (parent->getLeft() == node) parent->setLeft(r);
+    else parent->setRight(r);
+}
+
+/**
+* A plain right rotation at node (its left child takes its place).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::pivotRight(Node<Key, Value>* node)
+{
+    Node<Key, Value>* l = node->getLeft();
+    Node<Key, Value>* parent = node->getParent();
+    node->setLeft(l->getRight());
+    if (l->getRight() != NULL) l->getRight()->setParent(node);
+    l->setRight(node);
+    l->setParent(parent);
+    node->setParent(l);
+    if (parent == NULL) root_ = l;
+    else if (parent->getLeft() == node) parent->setLeft(l);
+    else parent->setRight(l);
+}
+
+/**
+* Day-Stout-Warren on the subtree at node: right rotations flatten it
+* into a sorted right-leaning vine, then rounds of left rotations fold
+* the vine into a complete tree hanging from the same place.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuildSubtree(Node<Key, Value>* node)
+{
+    Node<Key, Value>* parent = node->getParent();
+    bool left = (parent != NULL && parent->getLeft() == node);
+
+    size_t count = 0;
+    Node<Key, Value>* current = node;
+    while (current != NULL) {
+        Node<Key, Value>* l = current->getLeft();
+        if (l != NULL) {
+            pivotRight(current);
+            current = l;
+        } else {
+            count++;
+            current = current->getRight();
+        }
+    }
+
+    // largest 2^k - 1 that fits; the leftover forms the partial bottom row
+    size_t full = 1;
+    while (full * 2 + 1 <= count) {
+        full = full * 2 + 1;
+    }
+    compressVine(parent, left, count - full);
+    while (full > 1) {
+        full /= 2;
+        compressVine(parent, left, full);
+    }
+}
+
+/**
+* One DSW pass: left-rotates count alternate nodes down the right spine
+* of the subtree hanging from parent (or the root when parent is NULL).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compressVine(Node<Key, Value>* parent, bool left, size_t count)
+{
+    Node<Key, Value>* current = (parent == NULL) ? root_ : (left ? parent->getLeft() : parent->getRight());
+    for (size_t i = 0; i < count; ++i) {
+        Node<Key, Value>* next = current->getRight();
+        pivotLeft(current);
+        current = next->getRight();
     }
 }
 
@@ -638,6 +1701,93 @@ std::pair<bool, int> BinarySearchTree<Key, Value>::checkBalance(Node<Key, Value>
     return {isBalanced, height};
 }
 
+/**
+ * Return true iff every structural invariant holds: the root has no
+ * parent, each child points back at its parent, keys are strictly
+ * increasing in-order, and validateNode() accepts every node given the
+ * real heights of its subtrees.
+ *
+ * Runs in one O(n) post-order pass with an explicit stack, so it is
+ * safe to call on degenerate trees that would overflow checkBalance().
+ */
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::validate() const
+{
+    if (root_ == NULL) {
+        return true;
+    }
+    if (root_->getParent() != NULL) {
+        return false;
+    }
+
+    struct Frame {
+        Node<Key, Value>* node;
+        int state;          // 0 = descend left, 1 = visit + descend right, 2 = finish
+        int leftHeight;
+    };
+
+    std::vector<Frame> stack;
+    Frame first = { root_, 0, -1 };
+    stack.push_back(first);
+    Node<Key, Value>* prev = NULL;
+    int childHeight = -1;
+
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        Node<Key, Value>* node = top.node;
+
+        if (top.state == 0) {
+            top.state = 1;
+            Node<Key, Value>* left = node->getLeft();
+            if (left != NULL) {
+                if (left->getParent() != node) return false;
+                Frame f = { left, 0, -1 };
+                stack.push_back(f);
+            }
+            else {
+                childHeight = -1;
+            }
+        }
+        else if (top.state == 1) {
+            top.state = 2;
+            top.leftHeight = childHeight;
+            if (prev != NULL && !(prev->getKey() < node->getKey())) {
+                return false;
+            }
+            prev = node;
+            Node<Key, Value>* right = node->getRight();
+            if (right != NULL) {
+                if (right->getParent() != node) return false;
+                Frame f = { right, 0, -1 };
+                stack.push_back(f);
+            }
+            else {
+                childHeight = -1;
+            }
+        }
+        else {
+            int leftHeight = top.leftHeight;
+            int rightHeight = childHeight;
+            if (!validateNode(node, leftHeight, rightHeight)) {
+                return false;
+            }
+            childHeight = 1 + std::max(leftHeight, rightHeight);
+            stack.pop_back();
+        }
+    }
+    return true;
+}
+
+/**
+ * Per-node hook for validate(). A plain BST has no per-node invariants
+ * beyond those validate() already checks.
+ */
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    return true;
+}
+
 
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
@@ -0,0 +1,113 @@
+// Write bursts into an AVLTree vs. a BufferedAVLTree, with reads between.
+//
+//   make buffered-bench
+//   ./buffered-bench [preload] [writes] [reads-per-1k-writes] [threshold ...]
+//
+// Each key distribution is run separately:
+//   uniform  keys spread over the whole key space
+//   hot      90% of writes go to 1% of the keys
+//   window   keys drift upwards through a narrow window, as with
+//            timestamps arriving slightly out of order
+// Times include the final flush(), so the buffered numbers are the full
+// cost of getting every write into the tree.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "bufferedavl.h"
+#include "benchrand.h"
+
+using namespace std;
+
+enum Dist { UNIFORM, HOT, WINDOW, NUM_DISTS };
+static const char* distNames[NUM_DISTS] = { "uniform", "hot", "window" };
+
+static double elapsedNs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t nextKey(Dist dist, uint64_t i, uint64_t space, uint64_t& state)
+{
+    uint64_t r = nextRand(state);
+    switch (dist) {
+    case HOT:
+        return (r % 10 != 0) ? (r >> 8) % (space / 100 + 1) : (r >> 8) % space;
+    case WINDOW:
+        return (i * 4 + r % 4096) % space;
+    default:
+        return r % space;
+    }
+}
+
+template <typename Tree>
+static double run(Tree& tree, Dist dist, uint64_t preload, uint64_t writes, uint64_t reads, uint64_t& hits)
+{
+    const uint64_t space = preload * 4;
+    uint64_t state = 104;
+    for (uint64_t i = 0; i < preload; ++i) {
+        uint64_t k = nextRand(state) % space;
+        tree.insert(make_pair(k, k));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < writes; ++i) {
+        uint64_t k = nextKey(dist, i, space, state);
+        if (k & 8) {
+            tree.insert(make_pair(k, i));
+        } else {
+            tree.remove(k);
+        }
+        if (i % 1000 < reads && tree.find(nextRand(state) % space) != tree.end()) {
+            hits++;
+        }
+    }
+    return elapsedNs(start);
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t preload = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t writes = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+    uint64_t reads = argc > 3 ? strtoull(argv[3], NULL, 10) : 10;
+    vector<size_t> thresholds;
+    for (int i = 4; i < argc; ++i) {
+        thresholds.push_back(strtoull(argv[i], NULL, 10));
+    }
+    if (thresholds.empty()) {
+        thresholds.push_back(256);
+        thresholds.push_back(4096);
+    }
+
+    cout << preload << " keys preloaded, " << writes << " writes, "
+         << reads << " reads per 1000 writes" << endl;
+    cout << setw(8) << "keys" << setw(12) << "tree" << setw(14) << "ns/write" << setw(12) << "speedup" << endl;
+
+    for (int d = 0; d < NUM_DISTS; ++d) {
+        Dist dist = (Dist)d;
+        uint64_t plainHits = 0;
+        AVLTree<uint64_t, uint64_t> plain;
+        double plainNs = run(plain, dist, preload, writes, reads, plainHits);
+        cout << setw(8) << distNames[d] << setw(12) << "AVLTree" << fixed << setprecision(1)
+             << setw(14) << plainNs / writes << endl;
+
+        for (size_t t = 0; t < thresholds.size(); ++t) {
+            uint64_t hits = 0;
+            BufferedAVLTree<uint64_t, uint64_t> buffered(thresholds[t]);
+            double ns = run(buffered, dist, preload, writes, reads, hits);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            buffered.flush();
+            ns += elapsedNs(start);
+            if (hits != plainHits || buffered.size() != plain.size()) {
+                cerr << "buffered-bench: buffered and plain trees disagree" << endl;
+                return 1;
+            }
+            cout << setw(8) << distNames[d] << setw(6) << "buf " << setw(6) << thresholds[t]
+                 << setw(14) << ns / writes << setw(11) << setprecision(2) << plainNs / ns << "x"
+                 << setprecision(1) << endl;
+        }
+    }
+    return 0;
+}
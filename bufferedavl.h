@@ -0,0 +1,447 @@
+#ifndef BUFFEREDAVL_H
+#define BUFFEREDAVL_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "avlbst.h"
+
+/**
+ * An AVLTree with a write buffer in front of it, for bursty writers.
+ *
+ * insert() and remove() never touch the tree: they record the write in
+ * a small sorted delta buffer, removals as tombstones. When the buffer
+ * passes the flush threshold, or on flush(), it is applied to the tree
+ * in one pass in key order, each search starting from the previous
+ * key's node (see BinarySearchTree::insert(hint, item)) so that the
+ * batch shares the upper levels of its paths instead of descending
+ * from the root once per write.
+ *
+ * find() and iteration look at the buffer and the tree together, so
+ * reads always see every write. Buffered entries shadow the tree's.
+ *
+ * Differences from AVLTree:
+ *  - insert() and remove() return nothing, since reporting whether the
+ *    key was present would need the tree lookup the buffer avoids;
+ *  - remove() needs a default-constructible Value for its tombstone;
+ *  - size() looks up each buffered key in the tree;
+ *  - iterators and references are invalidated by flush(), and so by
+ *    any insert()/remove() that passes the threshold.
+ */
+template <typename Key, typename Value>
+class BufferedAVLTree
+{
+public:
+    typedef std::pair<const Key, Value> Item;
+
+    explicit BufferedAVLTree(size_t flushThreshold = 256);
+
+    class iterator;
+    void insert(const Item& keyValuePair);
+    void remove(const Key& key);
+    void flush();
+    void clear();
+    bool validate() const;
+    void print() const;
+    bool empty() const;
+    size_t size() const;
+    size_t pending() const;
+    void setFlushThreshold(size_t flushThreshold);
+
+protected:
+    struct Entry {
+        Entry(const Key& key, const Value& value, bool tombstone) :
+            item(key, value), tombstone(tombstone) { }
+
+        Item item;
+        bool tombstone;     // removes any tree entry for this key
+    };
+
+public:
+    /**
+    * Merges the buffer and the tree in key order, skipping tombstones
+    * and tree entries that the buffer shadows.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        Item& operator*() const;
+        Item* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BufferedAVLTree<Key, Value>;
+        iterator(const BufferedAVLTree<Key, Value>* owner, size_t bufferPos,
+                 typename AVLTree<Key, Value>::iterator treeIt);
+        void settle();
+
+        const BufferedAVLTree<Key, Value>* owner_;
+        size_t bufferPos_;
+        typename AVLTree<Key, Value>::iterator treeIt_;
+        bool fromBuffer_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    size_t lowerIndex(const Key& key) const;
+    bool buffered(const Key& key, size_t& index) const;
+    void record(size_t index, const Key& key, const Value& value, bool tombstone);
+    void maybeFlush();
+
+    AVLTree<Key, Value> tree_;
+    std::deque<Entry> entries_;     // stable storage, append only
+    std::vector<Entry*> buffer_;    // entries_ sorted by key, one per key
+    size_t flushThreshold_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the BufferedAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::iterator::iterator() : owner_(NULL), bufferPos_(0), fromBuffer_(false)
+{
+
+}
+
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::iterator::iterator(const BufferedAVLTree<Key, Value>* owner, size_t bufferPos,
+                                                typename AVLTree<Key, Value>::iterator treeIt) :
+    owner_(owner), bufferPos_(bufferPos), treeIt_(treeIt), fromBuffer_(false)
+{
+    settle();
+}
+
+/**
+ * Moves past tombstones and the tree entries they hide, then decides
+ * whether the current item comes from the buffer or the tree.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::iterator::settle()
+{
+    const std::vector<Entry*>& buffer = owner_->buffer_;
+    typename AVLTree<Key, Value>::iterator treeEnd = owner_->tree_.end();
+    while (bufferPos_ < buffer.size()) {
+        const Key& key = buffer[bufferPos_]->item.first;
+        if (treeIt_ != treeEnd && treeIt_->first < key) {
+            fromBuffer_ = false;
+            return;
+        }
+        if (treeIt_ != treeEnd && !(key < treeIt_->first)) {
+            // shadowed: the buffered entry replaces or removes it
+            ++treeIt_;
+        }
+        if (!buffer[bufferPos_]->tombstone) {
+            fromBuffer_ = true;
+            return;
+        }
+        ++bufferPos_;
+    }
+    fromBuffer_ = false;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& BufferedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return fromBuffer_ ? owner_->buffer_[bufferPos_]->item : *treeIt_;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* BufferedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(**this);
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return bufferPos_ == rhs.bufferPos_ && treeIt_ == rhs.treeIt_;
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator&
+BufferedAVLTree<Key, Value>::iterator::operator++()
+{
+    if (fromBuffer_) {
+        ++bufferPos_;
+    } else {
+        ++treeIt_;
+    }
+    settle();
+    return *this;
+}
+
+/*
+------------------------------------------------------------
+End implementations for the BufferedAVLTree::iterator class.
+------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::BufferedAVLTree(size_t flushThreshold) :
+    flushThreshold_(flushThreshold)
+{
+
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::empty() const
+{
+    return begin() == end();
+}
+
+/**
+ * Number of live keys, counting the buffer's effect on the tree.
+ */
+template<class Key, class Value>
+size_t BufferedAVLTree<Key, Value>::size() const
+{
+    size_t live = tree_.size();
+    for (size_t i = 0; i < buffer_.size(); ++i) {
+        bool inTree = tree_.find(buffer_[i]->item.first) != tree_.end();
+        if (buffer_[i]->tombstone && inTree) {
+            live--;
+        } else if (!buffer_[i]->tombstone && !inTree) {
+            live++;
+        }
+    }
+    return live;
+}
+
+/**
+ * Number of buffered writes (including tombstones) not yet applied.
+ */
+template<class Key, class Value>
+size_t BufferedAVLTree<Key, Value>::pending() const
+{
+    return buffer_.size();
+}
+
+/**
+ * Sets the most keys the buffer holds before it is flushed; 0 applies
+ * every write to the tree immediately.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::setFlushThreshold(size_t flushThreshold)
+{
+    flushThreshold_ = flushThreshold;
+    maybeFlush();
+}
+
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::clear()
+{
+    tree_.clear();
+    buffer_.clear();
+    entries_.clear();
+}
+
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::print() const
+{
+    for (iterator it = begin(); it != end(); ++it) {
+        std::cout << '(' << it->first << ", " << it->second << ") ";
+    }
+    std::cout << "\n";
+}
+
+/**
+ * The tree must be a valid AVL tree and the buffer strictly sorted.
+ */
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::validate() const
+{
+    if (!tree_.validate()) {
+        return false;
+    }
+    for (size_t i = 1; i < buffer_.size(); ++i) {
+        if (!(buffer_[i - 1]->item.first < buffer_[i]->item.first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::begin() const
+{
+    return iterator(this, 0, tree_.begin());
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::end() const
+{
+    return iterator(this, buffer_.size(), tree_.end());
+}
+
+/**
+ * Position of the first buffered key not less than key.
+ */
+template<class Key, class Value>
+size_t BufferedAVLTree<Key, Value>::lowerIndex(const Key& key) const
+{
+    size_t lo = 0, hi = buffer_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (buffer_[mid]->item.first < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * True if key has a buffered entry, which is then at index; otherwise
+ * index is where one would go.
+ */
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::buffered(const Key& key, size_t& index) const
+{
+    index = lowerIndex(key);
+    return index < buffer_.size() && !(key < buffer_[index]->item.first);
+}
+
+/**
+ * Looks in the buffer first, then the tree.
+ */
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::find(const Key& key) const
+{
+    size_t index;
+    if (buffered(key, index)) {
+        if (buffer_[index]->tombstone) {
+            return end();
+        }
+        return iterator(this, index, tree_.lower_bound(key));
+    }
+    typename AVLTree<Key, Value>::iterator treeIt = tree_.find(key);
+    if (treeIt == tree_.end()) {
+        return end();
+    }
+    return iterator(this, index, treeIt);
+}
+
+/**
+ * Returns the value associated with the key, inserting a
+ * default-constructed value first if the key is missing.
+ */
+template<class Key, class Value>
+Value& BufferedAVLTree<Key, Value>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it != end()) {
+        return it->second;
+    }
+    insert(std::make_pair(key, Value()));
+    return find(key)->second;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value const & BufferedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+ * Puts a buffered entry for key at index, reusing the existing one if
+ * the key is already buffered.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::record(size_t index, const Key& key, const Value& value, bool tombstone)
+{
+    if (index < buffer_.size() && !(key < buffer_[index]->item.first)) {
+        buffer_[index]->item.second = value;
+        buffer_[index]->tombstone = tombstone;
+        return;
+    }
+    entries_.push_back(Entry(key, value, tombstone));
+    buffer_.insert(buffer_.begin() + index, &entries_.back());
+}
+
+/**
+ * Buffers the write; the key's value is overwritten if it is present.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::insert(const Item& keyValuePair)
+{
+    record(lowerIndex(keyValuePair.first), keyValuePair.first, keyValuePair.second, false);
+    maybeFlush();
+}
+
+/**
+ * Buffers a tombstone for key, replacing any buffered insert.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::remove(const Key& key)
+{
+    size_t index;
+    if (buffered(key, index)) {
+        buffer_[index]->tombstone = true;
+        return;
+    }
+    record(index, key, Value(), true);
+    maybeFlush();
+}
+
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::maybeFlush()
+{
+    if (buffer_.size() > flushThreshold_) {
+        flush();
+    }
+}
+
+/**
+ * Applies every buffered write to the tree in key order and empties
+ * the buffer.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::flush()
+{
+    typename AVLTree<Key, Value>::iterator hint = tree_.end();
+    for (size_t i = 0; i < buffer_.size(); ++i) {
+        Entry* entry = buffer_[i];
+        if (entry->tombstone) {
+            typename AVLTree<Key, Value>::iterator it = tree_.find(hint, entry->item.first);
+            if (it != tree_.end()) {
+                hint = tree_.erase(it);
+            }
+        } else {
+            hint = tree_.insert(hint, entry->item).first;
+        }
+    }
+    buffer_.clear();
+    entries_.clear();
+}
+
+#endif
@@ -0,0 +1,87 @@
+// Incremental checkpoints of CheckpointedAVLTree at several churn rates.
+//
+//   make checkpoint-bench
+//   ./checkpoint-bench [keys] [dir]
+//
+// Writes a full base image, then for each churn level updates that many
+// random keys (a tenth of them removed) and writes a delta, then restores
+// the base plus all deltas into a fresh tree. dir defaults to
+// /tmp/checkpoint-bench and is left behind for inspection.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "checkpointavl.h"
+#include "benchrand.h"
+
+using namespace std;
+
+typedef CheckpointedAVLTree<uint64_t, uint64_t> Tree;
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* label, const CheckpointStats& stats, double sec)
+{
+    cout << setw(12) << label << setw(8) << (stats.full ? "base" : "delta") << setw(11) << stats.records
+         << setw(8) << stats.tombstones << setw(11) << stats.nodesVisited << setw(13) << stats.bytes
+         << fixed << setprecision(2) << setw(11) << sec * 1e3 << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 4000000;
+    string dir = argc > 2 ? argv[2] : "/tmp/checkpoint-bench";
+    uint64_t state = 88172645463325252ull;
+
+    Tree tree;
+    for (uint64_t i = 0; i < keys; ++i) {
+        tree.insert(make_pair(nextRand(state) % (keys * 2), i));
+    }
+
+    CheckpointStore store(dir);
+    cout << tree.size() << " keys, checkpoints in " << dir << endl;
+    cout << setw(12) << "churn" << setw(8) << "kind" << setw(11) << "records" << setw(8) << "tombs"
+         << setw(11) << "visited" << setw(13) << "bytes" << setw(11) << "ms" << endl;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CheckpointStats stats = tree.checkpoint(store, true);
+    report("full", stats, secondsSince(start));
+
+    for (uint64_t churn = 100; churn <= keys / 10; churn *= 10) {
+        for (uint64_t i = 0; i < churn; ++i) {
+            uint64_t k = nextRand(state) % (keys * 2);
+            if (i % 10 == 0) {
+                tree.remove(k);
+            }
+            else {
+                tree.insert(make_pair(k, i));
+            }
+        }
+        start = chrono::steady_clock::now();
+        stats = tree.checkpoint(store);
+        report(to_string(churn).c_str(), stats, secondsSince(start));
+    }
+
+    Tree restored;
+    start = chrono::steady_clock::now();
+    restored.restore(store);
+    double restoreSec = secondsSince(start);
+    if (restored.size() != tree.size()) {
+        cerr << "checkpoint-bench: restored " << restored.size() << " keys, expected " << tree.size() << endl;
+        return 1;
+    }
+    for (Tree::iterator a = tree.begin(), b = restored.begin(); a != tree.end(); ++a, ++b) {
+        if (a->first != b->first || a->second != b->second) {
+            cerr << "checkpoint-bench: restored tree differs" << endl;
+            return 1;
+        }
+    }
+    cout << "restore of " << store.files().size() << " files: " << restoreSec * 1e3 << " ms" << endl;
+    return 0;
+}
@@ -0,0 +1,737 @@
+#ifndef CHECKPOINTAVL_H
+#define CHECKPOINTAVL_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/**
+ * Flag bits kept in every CheckpointNode.
+ */
+enum CheckpointFlags
+{
+    CHECKPOINT_DIRTY = 1,       // key or value written since the last checkpoint
+    CHECKPOINT_SUBTREE = 2,     // this node or one below it is dirty
+    CHECKPOINT_NEW = 4          // inserted since the last checkpoint
+};
+
+/**
+ * What one checkpoint() call wrote.
+ */
+struct CheckpointStats
+{
+    bool full;              // a base image rather than a delta
+    size_t records;         // key/value pairs written
+    size_t tombstones;      // removed keys written
+    size_t nodesVisited;    // nodes walked to find the dirty ones
+    uint64_t bytes;         // size of the file written
+
+    CheckpointStats() : full(false), records(0), tombstones(0), nodesVisited(0), bytes(0) {}
+};
+
+/**
+ * Header of every checkpoint file. A file holds `tombstones` keys to
+ * remove, then `records` key/value pairs in key order, as raw bytes.
+ */
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t keyBytes;
+    uint32_t valueBytes;
+    uint64_t tombstones;
+    uint64_t records;
+};
+
+static const char CHECKPOINT_MAGIC[8] = { 'A', 'V', 'L', 'C', 'K', 'P', 'T', '1' };
+
+/**
+ * A directory holding one base image and the deltas written after it,
+ * listed in order by a text MANIFEST:
+ *
+ *     avl-checkpoint 1
+ *     <last generation used>
+ *     <base file> <bytes>
+ *     <delta file> <bytes>
+ *     ...
+ *
+ * Files are never rewritten: each checkpoint goes to a new file, and the
+ * MANIFEST is replaced (written aside, then renamed over) only once that
+ * file is complete, so a crash leaves the previous checkpoint readable.
+ * Files dropped by a new base are removed after the switch. Nothing is
+ * fsynced; surviving power loss is up to the caller.
+ *
+ * Several stores, in one process or many, may share a directory. New
+ * file names are claimed with O_EXCL, and the MANIFEST is only replaced
+ * under an exclusive lock on LOCK and if no other store has replaced it
+ * since this one last read it (refresh()); otherwise the commit throws
+ * std::runtime_error and the directory is left as the other store wrote
+ * it.
+ */
+class CheckpointStore
+{
+public:
+    explicit CheckpointStore(const std::string& dir);
+
+    const std::string& dir() const;
+    uint64_t generation() const;
+    std::string path(const std::string& name) const;
+    bool empty() const;
+    const std::vector<std::string>& files() const;
+    uint64_t baseBytes() const;
+    uint64_t deltaBytes() const;
+
+    void refresh();
+    std::string nextFile(const char* kind);
+    void commitBase(const std::string& name, uint64_t bytes);
+    void commitDelta(const std::string& name, uint64_t bytes);
+
+protected:
+    void load();
+    uint64_t manifestGeneration() const;
+    void save(const std::vector<std::string>& files, const std::vector<uint64_t>& sizes);
+
+    std::string dir_;
+    std::vector<std::string> files_;    // base first, then deltas
+    std::vector<uint64_t> sizes_;
+    uint64_t generation_;               // last one claimed by nextFile()
+    uint64_t loadedGeneration_;         // the MANIFEST's when last read or written
+};
+
+/**
+ * Opens dir, creating it if needed, and reads its MANIFEST if there is
+ * one.
+ */
+inline CheckpointStore::CheckpointStore(const std::string& dir) : dir_(dir), generation_(0), loadedGeneration_(0)
+{
+    mkdir(dir_.c_str(), 0777);
+    load();
+}
+
+inline const std::string& CheckpointStore::dir() const
+{
+    return dir_;
+}
+
+/**
+ * The MANIFEST's generation as of the last refresh() or commit; every
+ * checkpoint written to the directory, through any CheckpointStore,
+ * moves it on.
+ */
+inline uint64_t CheckpointStore::generation() const
+{
+    return loadedGeneration_;
+}
+
+inline std::string CheckpointStore::path(const std::string& name) const
+{
+    return dir_ + "/" + name;
+}
+
+/**
+ * True until a base image has been committed.
+ */
+inline bool CheckpointStore::empty() const
+{
+    return files_.empty();
+}
+
+inline const std::vector<std::string>& CheckpointStore::files() const
+{
+    return files_;
+}
+
+inline uint64_t CheckpointStore::baseBytes() const
+{
+    return sizes_.empty() ? 0 : sizes_[0];
+}
+
+inline uint64_t CheckpointStore::deltaBytes() const
+{
+    uint64_t total = 0;
+    for (size_t i = 1; i < sizes_.size(); ++i) {
+        total += sizes_[i];
+    }
+    return total;
+}
+
+/**
+ * Re-reads the MANIFEST, picking up checkpoints other stores wrote.
+ */
+inline void CheckpointStore::refresh()
+{
+    load();
+}
+
+/**
+ * Creates an empty file no other checkpoint uses, e.g. "delta-000012.ckpt",
+ * and returns its name. O_EXCL keeps two writers from claiming the same
+ * one.
+ */
+inline std::string CheckpointStore::nextFile(const char* kind)
+{
+    char name[64];
+    while (true) {
+        snprintf(name, sizeof(name), "%s-%06llu.ckpt", kind, static_cast<unsigned long long>(++generation_));
+        int fd = open(path(name).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            close(fd);
+            return name;
+        }
+        if (errno != EEXIST) {
+            throw std::runtime_error("checkpoint: cannot create " + path(name));
+        }
+    }
+}
+
+inline void CheckpointStore::commitBase(const std::string& name, uint64_t bytes)
+{
+    std::vector<std::string> old(files_);
+    save(std::vector<std::string>(1, name), std::vector<uint64_t>(1, bytes));
+    for (size_t i = 0; i < old.size(); ++i) {
+        std::remove(path(old[i]).c_str());
+    }
+}
+
+inline void CheckpointStore::commitDelta(const std::string& name, uint64_t bytes)
+{
+    std::vector<std::string> files(files_);
+    std::vector<uint64_t> sizes(sizes_);
+    files.push_back(name);
+    sizes.push_back(bytes);
+    save(files, sizes);
+}
+
+inline void CheckpointStore::load()
+{
+    files_.clear();
+    sizes_.clear();
+    generation_ = 0;
+    loadedGeneration_ = 0;
+    std::ifstream in(path("MANIFEST").c_str());
+    if (!in) {
+        return;
+    }
+    std::string tag;
+    int version = 0;
+    in >> tag >> version >> generation_;
+    if (!in || tag != "avl-checkpoint" || version != 1) {
+        throw std::runtime_error("checkpoint: bad MANIFEST in " + dir_);
+    }
+    loadedGeneration_ = generation_;
+    std::string name;
+    uint64_t bytes;
+    while (in >> name >> bytes) {
+        files_.push_back(name);
+        sizes_.push_back(bytes);
+    }
+}
+
+/**
+ * The generation the MANIFEST on disk has now, 0 if there is none.
+ */
+inline uint64_t CheckpointStore::manifestGeneration() const
+{
+    std::ifstream in(path("MANIFEST").c_str());
+    std::string tag;
+    int version = 0;
+    uint64_t generation = 0;
+    in >> tag >> version >> generation;
+    return in ? generation : 0;
+}
+
+/**
+ * Replaces the MANIFEST with files and sizes, unless another store has
+ * replaced it since this one read it. The check and the rename hold the
+ * lock on LOCK, so of two stores that read the same MANIFEST only the
+ * first to commit succeeds.
+ */
+inline void CheckpointStore::save(const std::vector<std::string>& files, const std::vector<uint64_t>& sizes)
+{
+    int lock = open(path("LOCK").c_str(), O_RDWR | O_CREAT, 0666);
+    if (lock < 0 || flock(lock, LOCK_EX) != 0) {
+        if (lock >= 0) {
+            close(lock);
+        }
+        throw std::runtime_error("checkpoint: cannot lock " + dir_);
+    }
+    try {
+        if (manifestGeneration() != loadedGeneration_) {
+            throw std::runtime_error("checkpoint: MANIFEST in " + dir_ + " was changed by another writer");
+        }
+        std::string temp = path("MANIFEST.tmp");
+        {
+            std::ofstream out(temp.c_str(), std::ios::trunc);
+            out << "avl-checkpoint 1\n" << generation_ << "\n";
+            for (size_t i = 0; i < files.size(); ++i) {
+                out << files[i] << " " << sizes[i] << "\n";
+            }
+            out.close();
+            if (!out) {
+                throw std::runtime_error("checkpoint: cannot write " + temp);
+            }
+        }
+        if (std::rename(temp.c_str(), path("MANIFEST").c_str()) != 0) {
+            throw std::runtime_error("checkpoint: cannot replace MANIFEST in " + dir_);
+        }
+    }
+    catch (...) {
+        close(lock);
+        throw;
+    }
+    close(lock);
+    files_ = files;
+    sizes_ = sizes;
+    loadedGeneration_ = generation_;
+}
+
+/**
+ * An AVLNode with CheckpointFlags. The flag byte fits in AVLNode's tail
+ * padding, so the node is no larger.
+ */
+template <typename Key, typename Value>
+class CheckpointNode : public AVLNode<Key, Value>
+{
+public:
+    CheckpointNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+
+    uint8_t getFlags() const;
+    void setFlags(uint8_t flags);
+
+protected:
+    uint8_t flags_;
+};
+
+template<class Key, class Value>
+CheckpointNode<Key, Value>::CheckpointNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), flags_(0)
+{
+
+}
+
+template<class Key, class Value>
+uint8_t CheckpointNode<Key, Value>::getFlags() const
+{
+    return flags_;
+}
+
+template<class Key, class Value>
+void CheckpointNode<Key, Value>::setFlags(uint8_t flags)
+{
+    flags_ = flags;
+}
+
+/**
+ * An AVL tree that can be saved incrementally. Every node written since
+ * the last checkpoint is marked dirty, and every node above a dirty one
+ * carries a subtree bit, kept right through rotations by the AVLTree
+ * augmentation hooks. checkpoint() only descends into marked subtrees, so
+ * it visits O(c log n) nodes for c changed keys and writes just those
+ * keys plus the keys removed since (tombstones), as a delta file. The
+ * first checkpoint, one after clear(), and one whose deltas have grown
+ * past the base write a full base image instead.
+ *
+ * Keys and values go to disk as raw bytes, so both must be trivially
+ * copyable, and files are only portable between builds with the same
+ * layout. Values changed in place through iterators or operator[]
+ * bypass the hooks: update them with insert(), or call markDirty().
+ */
+template <typename Key, typename Value>
+class CheckpointedAVLTree : public AVLTree<Key, Value, VirtualAugment>
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "checkpoint files hold raw key and value bytes");
+
+public:
+    CheckpointedAVLTree();
+
+    CheckpointStats checkpoint(CheckpointStore& store, bool full = false);
+    void restore(CheckpointStore& store);
+    void markDirty(const Key& key);
+    size_t pendingTombstones() const;
+
+protected:
+    typedef CheckpointNode<Key, Value> CkptNode;
+
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) override;
+    virtual AVLNode<Key, Value>* relocateNode(AVLNode<Key, Value>* node, void* where) override;
+    virtual size_t nodeBytes() const override;
+    virtual const std::type_info& nodeType() const override;
+    virtual void updateAugment(AVLNode<Key, Value>* node) override;
+    virtual void updateAugmentPath(AVLNode<Key, Value>* node) override;
+    virtual Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* unlinkNode(Node<Key, Value>* node) override;
+    virtual void assignValue(Node<Key, Value>* node, const Value& value) override;
+    virtual void clearHelper(Node<Key, Value>* node) override;
+    virtual bool validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const override;
+
+    static CkptNode* asCkpt(Node<Key, Value>* node);
+    static bool subtreeDirty(Node<Key, Value>* node);
+    template <typename Visit>
+    size_t walk(bool all, Visit visit);
+    uint64_t writeFile(const std::string& path, bool full);
+    void readFile(const std::string& path);
+    void markSynced(const CheckpointStore& store);
+    bool syncedWith(const CheckpointStore& store) const;
+
+    // Keys removed since the last checkpoint that it had written; only
+    // kept while the next checkpoint can be a delta.
+    std::vector<Key> tombstones_;
+    // True while the store last written or restored holds exactly the
+    // tree minus the marked changes. Which store that is, by directory
+    // and generation, so that a delta never goes to any other.
+    bool synced_;
+    std::string syncedDir_;
+    uint64_t syncedGeneration_;
+};
+
+template<class Key, class Value>
+CheckpointedAVLTree<Key, Value>::CheckpointedAVLTree() : synced_(false), syncedGeneration_(0)
+{
+
+}
+
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::markSynced(const CheckpointStore& store)
+{
+    synced_ = !store.empty();
+    syncedDir_ = store.dir();
+    syncedGeneration_ = store.generation();
+}
+
+/**
+ * True if store is the one the tree was last synced with and nothing
+ * has been written to it since.
+ */
+template<class Key, class Value>
+bool CheckpointedAVLTree<Key, Value>::syncedWith(const CheckpointStore& store) const
+{
+    return synced_ && store.dir() == syncedDir_ && store.generation() == syncedGeneration_;
+}
+
+template<class Key, class Value>
+CheckpointNode<Key, Value>* CheckpointedAVLTree<Key, Value>::asCkpt(Node<Key, Value>* node)
+{
+    return static_cast<CkptNode*>(node);
+}
+
+template<class Key, class Value>
+bool CheckpointedAVLTree<Key, Value>::subtreeDirty(Node<Key, Value>* node)
+{
+    return node != NULL && (asCkpt(node)->getFlags() & CHECKPOINT_SUBTREE);
+}
+
+/**
+ * In-order walk over every node (all) or only into subtrees marked
+ * dirty. Returns the number of nodes visited.
+ */
+template<class Key, class Value>
+template<typename Visit>
+size_t CheckpointedAVLTree<Key, Value>::walk(bool all, Visit visit)
+{
+    size_t visited = 0;
+    std::vector<CkptNode*> stack;
+    Node<Key, Value>* node = this->root_;
+    while (true) {
+        while (node != NULL && (all || subtreeDirty(node))) {
+            stack.push_back(asCkpt(node));
+            node = node->getLeft();
+        }
+        if (stack.empty()) {
+            break;
+        }
+        CkptNode* current = stack.back();
+        stack.pop_back();
+        visited++;
+        node = current->getRight();
+        visit(current);
+    }
+    return visited;
+}
+
+/**
+ * Writes the tombstones and dirty records (or every record, if full) to
+ * path and returns the file's size. Leaves the flags alone.
+ */
+template<class Key, class Value>
+uint64_t CheckpointedAVLTree<Key, Value>::writeFile(const std::string& path, bool full)
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = sizeof(Value);
+    header.tombstones = full ? 0 : tombstones_.size();
+    header.records = 0;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!full) {
+        for (size_t i = 0; i < tombstones_.size(); ++i) {
+            out.write(reinterpret_cast<const char*>(&tombstones_[i]), sizeof(Key));
+        }
+    }
+    walk(full, [&](CkptNode* node) {
+        if (full || (node->getFlags() & CHECKPOINT_DIRTY)) {
+            out.write(reinterpret_cast<const char*>(&node->getKey()), sizeof(Key));
+            out.write(reinterpret_cast<const char*>(&node->getValue()), sizeof(Value));
+            header.records++;
+        }
+    });
+    uint64_t bytes = out.tellp();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::remove(path.c_str());
+        throw std::runtime_error("checkpoint: cannot write " + path);
+    }
+    return bytes;
+}
+
+/**
+ * Saves the tree to store: a delta holding only what changed since the
+ * last checkpoint or restore() against the same store, or a full base
+ * image when asked to, when there is no usable base, when the tree was
+ * last synced with another store (or this one has moved on since), or
+ * when the deltas already outweigh the base. Re-reads the MANIFEST
+ * first, so a checkpoint another store wrote meanwhile also forces a
+ * base. Clears the change marks only once the MANIFEST lists the new
+ * file, so a failed write or a commit lost to another writer (which
+ * throw std::runtime_error) loses nothing.
+ */
+template<class Key, class Value>
+CheckpointStats CheckpointedAVLTree<Key, Value>::checkpoint(CheckpointStore& store, bool full)
+{
+    CheckpointStats stats;
+    store.refresh();
+    stats.full = full || !syncedWith(store) || store.empty() || store.deltaBytes() > store.baseBytes();
+    stats.tombstones = stats.full ? 0 : tombstones_.size();
+    std::string name = store.nextFile(stats.full ? "base" : "delta");
+    try {
+        stats.bytes = writeFile(store.path(name), stats.full);
+        if (stats.full) {
+            store.commitBase(name, stats.bytes);
+        }
+        else {
+            store.commitDelta(name, stats.bytes);
+        }
+    }
+    catch (...) {
+        std::remove(store.path(name).c_str());
+        throw;
+    }
+    stats.records = (stats.bytes - sizeof(CheckpointHeader) - stats.tombstones * sizeof(Key))
+                    / (sizeof(Key) + sizeof(Value));
+
+    stats.nodesVisited = walk(stats.full, [](CkptNode* node) { node->setFlags(0); });
+    tombstones_.clear();
+    markSynced(store);
+    return stats;
+}
+
+/**
+ * Applies one checkpoint file: its tombstones, then its records.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::readFile(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    CheckpointHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("checkpoint: " + path + " is not a checkpoint file");
+    }
+    if (header.keyBytes != sizeof(Key) || header.valueBytes != sizeof(Value)) {
+        throw std::runtime_error("checkpoint: " + path + " was written for other key or value types");
+    }
+
+    typename std::aligned_storage<sizeof(Key), alignof(Key)>::type keyBuf;
+    typename std::aligned_storage<sizeof(Value), alignof(Value)>::type valueBuf;
+    const Key& key = *reinterpret_cast<const Key*>(&keyBuf);
+    const Value& value = *reinterpret_cast<const Value*>(&valueBuf);
+    for (uint64_t i = 0; i < header.tombstones && in.read(reinterpret_cast<char*>(&keyBuf), sizeof(Key)); ++i) {
+        this->remove(key);
+    }
+    // records are in key order, so each insert starts from the last one
+    typename AVLTree<Key, Value, VirtualAugment>::iterator hint = this->end();
+    for (uint64_t i = 0; i < header.records; ++i) {
+        in.read(reinterpret_cast<char*>(&keyBuf), sizeof(Key));
+        in.read(reinterpret_cast<char*>(&valueBuf), sizeof(Value));
+        if (!in) {
+            break;
+        }
+        hint = this->insert(hint, std::make_pair(key, value)).first;
+    }
+    if (!in) {
+        throw std::runtime_error("checkpoint: " + path + " is truncated");
+    }
+}
+
+/**
+ * Replaces the contents of the tree with the base image currently in
+ * store's MANIFEST and every delta after it. Starts over if another
+ * store commits a new base (removing the files being read) meanwhile.
+ * On failure throws std::runtime_error and leaves the tree empty.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::restore(CheckpointStore& store)
+{
+    while (true) {
+        this->clear();
+        store.refresh();
+        uint64_t generation = store.generation();
+        try {
+            for (size_t i = 0; i < store.files().size(); ++i) {
+                readFile(store.path(store.files()[i]));
+            }
+            break;
+        }
+        catch (...) {
+            this->clear();
+            store.refresh();
+            if (store.generation() == generation) {
+                throw;
+            }
+        }
+    }
+    walk(true, [](CkptNode* node) { node->setFlags(0); });
+    markSynced(store);
+}
+
+/**
+ * Marks key for the next checkpoint after its value was changed in place.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::markDirty(const Key& key)
+{
+    Node<Key, Value>* node = this->internalFind(key);
+    if (node != NULL) {
+        asCkpt(node)->setFlags(asCkpt(node)->getFlags() | CHECKPOINT_DIRTY);
+        updateAugmentPath(static_cast<AVLNode<Key, Value>*>(node));
+    }
+}
+
+template<class Key, class Value>
+size_t CheckpointedAVLTree<Key, Value>::pendingTombstones() const
+{
+    return tombstones_.size();
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* CheckpointedAVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new CkptNode(key, value, parent);
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* CheckpointedAVLTree<Key, Value>::relocateNode(AVLNode<Key, Value>* node, void* where)
+{
+    return new (where) CkptNode(*asCkpt(node));
+}
+
+template<class Key, class Value>
+size_t CheckpointedAVLTree<Key, Value>::nodeBytes() const
+{
+    return sizeof(CkptNode);
+}
+
+template<class Key, class Value>
+const std::type_info& CheckpointedAVLTree<Key, Value>::nodeType() const
+{
+    return typeid(CkptNode);
+}
+
+/**
+ * The subtree bit is the node's own dirty bit or either child's subtree
+ * bit, so a rotation only needs its two nodes recomputed.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::updateAugment(AVLNode<Key, Value>* node)
+{
+    uint8_t flags = asCkpt(node)->getFlags() & ~CHECKPOINT_SUBTREE;
+    if ((flags & CHECKPOINT_DIRTY) || subtreeDirty(node->getLeft()) || subtreeDirty(node->getRight())) {
+        flags |= CHECKPOINT_SUBTREE;
+    }
+    asCkpt(node)->setFlags(flags);
+}
+
+/**
+ * Recomputes up to the root rather than stopping early: a removal may
+ * have swapped a node with stale flags onto the path.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::updateAugmentPath(AVLNode<Key, Value>* node)
+{
+    while (node != NULL) {
+        updateAugment(node);
+        node = node->getParent();
+    }
+}
+
+/**
+ * Marks fresh and adopted nodes alike before the retrace propagates the
+ * subtree bit.
+ */
+template<class Key, class Value>
+Node<Key, Value>* CheckpointedAVLTree<Key, Value>::linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node)
+{
+    asCkpt(node)->setFlags(CHECKPOINT_DIRTY | CHECKPOINT_NEW);
+    return AVLTree<Key, Value, VirtualAugment>::linkNode(parent, left, node);
+}
+
+/**
+ * A key the store never saw needs no tombstone.
+ */
+template<class Key, class Value>
+Node<Key, Value>* CheckpointedAVLTree<Key, Value>::unlinkNode(Node<Key, Value>* node)
+{
+    if (synced_ && !(asCkpt(node)->getFlags() & CHECKPOINT_NEW)) {
+        tombstones_.push_back(node->getKey());
+    }
+    return AVLTree<Key, Value, VirtualAugment>::unlinkNode(node);
+}
+
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::assignValue(Node<Key, Value>* node, const Value& value)
+{
+    asCkpt(node)->setFlags(asCkpt(node)->getFlags() | CHECKPOINT_DIRTY);
+    AVLTree<Key, Value, VirtualAugment>::assignValue(node, value);
+}
+
+/**
+ * After clear() only a full image can describe the tree.
+ */
+template<class Key, class Value>
+void CheckpointedAVLTree<Key, Value>::clearHelper(Node<Key, Value>* node)
+{
+    AVLTree<Key, Value, VirtualAugment>::clearHelper(node);
+    tombstones_.clear();
+    synced_ = false;
+}
+
+/**
+ * Besides the AVL checks, the subtree bit must match the node's own dirty
+ * bit and its (already validated) children.
+ */
+template<class Key, class Value>
+bool CheckpointedAVLTree<Key, Value>::validateNode(Node<Key, Value>* node, int leftHeight, int rightHeight) const
+{
+    if (!AVLTree<Key, Value, VirtualAugment>::validateNode(node, leftHeight, rightHeight)) {
+        return false;
+    }
+    uint8_t flags = asCkpt(node)->getFlags();
+    bool expected = (flags & CHECKPOINT_DIRTY) || subtreeDirty(node->getLeft()) || subtreeDirty(node->getRight());
+    return ((flags & CHECKPOINT_SUBTREE) != 0) == expected;
+}
+
+#endif
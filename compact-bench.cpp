@@ -0,0 +1,91 @@
+// In-order scan and random find() on an AVLTree before and after compact().
+//
+//   make compact-bench
+//   ./compact-bench [keys] [lookups]
+//
+// The tree is aged with rounds of random removes and re-inserts so that
+// its nodes end up scattered across the heap before it is compacted.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+#include "benchrand.h"
+
+using namespace std;
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static double elapsedNs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+static void measure(Tree& tree, const vector<uint64_t>& keys, double& scanNs, double& findNs, uint64_t& check)
+{
+    size_t nodes = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        check += it->second;
+        nodes++;
+    }
+    scanNs = elapsedNs(start) / nodes;
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        Tree::iterator it = tree.find(keys[i]);
+        if (it != tree.end()) check += it->second;
+    }
+    findNs = elapsedNs(start) / keys.size();
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+
+    Tree tree;
+    uint64_t state = 104;
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t k = nextRand(state) % (n * 2);
+        tree.insert(make_pair(k, k));
+    }
+    for (int round = 0; round < 4; ++round) {
+        for (uint64_t i = 0; i < n / 2; ++i) {
+            tree.remove(nextRand(state) % (n * 2));
+        }
+        for (uint64_t i = 0; i < n / 2; ++i) {
+            uint64_t k = nextRand(state) % (n * 2);
+            tree.insert(make_pair(k, k));
+        }
+    }
+
+    vector<uint64_t> keys(lookups);
+    for (size_t i = 0; i < lookups; ++i) {
+        keys[i] = nextRand(state) % (n * 2);
+    }
+
+    double scanBefore, findBefore, scanAfter, findAfter;
+    uint64_t before = 0, after = 0;
+    measure(tree, keys, scanBefore, findBefore, before);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t reclaimed = tree.compact();
+    double compactMs = elapsedNs(start) / 1e6;
+
+    measure(tree, keys, scanAfter, findAfter, after);
+    if (before != after || !tree.validate()) {
+        cerr << "compact-bench: tree changed across compact()" << endl;
+        return 1;
+    }
+
+    cout << tree.size() << " keys, compact() took " << fixed << setprecision(1) << compactMs
+         << " ms and reclaimed " << reclaimed << " bytes" << endl;
+    cout << setw(8) << "" << setw(14) << "scan ns/node" << setw(14) << "find ns/op" << endl;
+    cout << setw(8) << "before" << setw(14) << scanBefore << setw(14) << findBefore << endl;
+    cout << setw(8) << "after" << setw(14) << scanAfter << setw(14) << findAfter << endl;
+    return 0;
+}
@@ -0,0 +1,1023 @@
+#ifndef COMPACTAVL_H
+#define COMPACTAVL_H
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <new>
+#include "avlbst.h"
+
+/**
+ * An AVL tree for small, trivially-copyable keys and values.
+ *
+ * Instead of one heap-allocated AVLNode per entry (vptr, three 64-bit
+ * pointers, balance, plus malloc's header), every node lives in a single
+ * contiguous array and links to its parent/children with 32-bit indices.
+ * For an int -> int map that is 24 bytes per entry instead of ~64.
+ *
+ * The public interface mirrors BinarySearchTree/AVLTree: insert(),
+ * remove(), erase(), extract() and insert(node_type&&), find(),
+ * find_many(), find_or_insert(), operator[], compact() and the checks.
+ * Cursors, hints, bounds, memory_usage() and tracing are AVLTree-only.
+ * Other differences:
+ *  - at most 2^32 - 1 entries;
+ *  - removing a key with two children moves the predecessor's item into
+ *    the removed key's slot, so iterators to the predecessor are
+ *    invalidated (as are all iterators when the array grows);
+ *  - node_type holds a copy of the item rather than a node, and only
+ *    moves between CompactAVLTrees.
+ *
+ * Use AVLMap<Key, Value> to pick this or AVLTree automatically.
+ */
+template <typename Key, typename Value>
+class CompactAVLTree
+{
+public:
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "CompactAVLTree requires trivially copyable keys and values");
+
+    CompactAVLTree();
+
+    class iterator;
+    class node_type;
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    std::pair<iterator, bool> insert(node_type&& handle);
+    void remove(const Key& key);
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    void clear();
+    void reserve(size_t n);
+    size_t compact();
+    bool isBalanced() const;
+    bool validate() const;
+    void print() const;
+    bool empty() const;
+    size_t size() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(const CompactAVLTree<Key, Value>* tree, uint32_t index);
+        const CompactAVLTree<Key, Value>* tree_;
+        uint32_t index_;
+    };
+
+    /**
+    * Holds an item taken out of a tree by extract() until insert() puts
+    * it into another CompactAVLTree.
+    */
+    class node_type
+    {
+    public:
+        node_type();
+
+        bool empty() const;
+        explicit operator bool() const;
+        const Key& key() const;
+        Value& mapped();
+        const Value& mapped() const;
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        explicit node_type(const std::pair<const Key, Value>& item);
+        std::pair<Key, Value> item_;
+        bool full_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    void find_many(const Key* keys, size_t count, iterator* out) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    template<typename Factory>
+    std::pair<iterator, bool> find_or_insert(const Key& key, Factory factory);
+
+protected:
+    static const uint32_t NIL = 0xFFFFFFFFu;
+
+    struct Slot {
+        Slot(const Key& key, const Value& value, uint32_t parent) :
+            item(key, value), parent(parent), left(NIL), right(NIL), balance(0) { }
+
+        std::pair<const Key, Value> item;
+        uint32_t parent;
+        uint32_t left;      // doubles as the free-list link for unused slots
+        uint32_t right;
+        int8_t balance;
+    };
+
+    uint32_t internalFind(const Key& key) const;
+    uint32_t locate(const Key& key, uint32_t& parent, bool& left) const;
+    uint32_t attach(uint32_t parent, bool left, const Key& key, const Value& value);
+    uint32_t allocSlot(const Key& key, const Value& value, uint32_t parent);
+    void rebuildSlot(uint32_t index, const Slot& slot);
+    void freeSlot(uint32_t index);
+    void unlinkSlot(uint32_t target);
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+    void rotateLeft(uint32_t index);
+    void rotateRight(uint32_t index);
+    void insertFix(uint32_t node);
+    void removeFix(uint32_t parent, bool removedLeft);
+    int checkHeights(bool checkStored) const;
+
+    // Non-const so that iterators can hand out mutable references, as
+    // BinarySearchTree::iterator does.
+    mutable std::vector<Slot> slots_;
+    uint32_t root_;
+    uint32_t freeHead_;
+    size_t size_;
+};
+
+/**
+ * True when CompactAVLTree can store Key/Value: both trivially copyable
+ * with a combined payload of at most 16 bytes.
+ */
+template <typename Key, typename Value>
+struct UseCompactAVL
+{
+    static const bool value = std::is_trivially_copyable<Key>::value &&
+                              std::is_trivially_copyable<Value>::value &&
+                              sizeof(Key) + sizeof(Value) <= 16;
+};
+
+/**
+ * An ordered map that is a CompactAVLTree for small trivially-copyable
+ * payloads and an AVLTree otherwise.
+ */
+template <typename Key, typename Value>
+using AVLMap = typename std::conditional<UseCompactAVL<Key, Value>::value,
+                                         CompactAVLTree<Key, Value>,
+                                         AVLTree<Key, Value> >::type;
+
+/*
+--------------------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator() : tree_(NULL), index_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator(const CompactAVLTree<Key, Value>* tree, uint32_t index) :
+    tree_(tree), index_(index)
+{
+
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& CompactAVLTree<Key, Value>::iterator::operator*() const
+{
+    return tree_->slots_[index_].item;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* CompactAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(tree_->slots_[index_].item);
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+/**
+* Advances the iterator's location using an in-order sequencing
+*/
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator&
+CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    const std::vector<Slot>& s = tree_->slots_;
+    if (s[index_].right != NIL) {
+        index_ = s[index_].right;
+        while (s[index_].left != NIL) {
+            index_ = s[index_].left;
+        }
+    }
+    else {
+        uint32_t parent = s[index_].parent;
+        while (parent != NIL && index_ == s[parent].right) {
+            index_ = parent;
+            parent = s[parent].parent;
+        }
+        index_ = parent;
+    }
+    return *this;
+}
+
+/*
+------------------------------------------------------------
+End implementations for the CompactAVLTree::iterator class.
+------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::node_type::node_type() : item_(), full_(false)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::node_type::node_type(const std::pair<const Key, Value>& item) :
+    item_(item), full_(true)
+{
+
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::node_type::empty() const
+{
+    return !full_;
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::node_type::operator bool() const
+{
+    return full_;
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+const Key& CompactAVLTree<Key, Value>::node_type::key() const
+{
+    return item_.first;
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+Value& CompactAVLTree<Key, Value>::node_type::mapped()
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+const Value& CompactAVLTree<Key, Value>::node_type::mapped() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::CompactAVLTree() : root_(NIL), freeHead_(NIL), size_(0)
+{
+
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template<class Key, class Value>
+size_t CompactAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+/**
+ * Pre-sizes the node array so that n entries fit without regrowing.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::reserve(size_t n)
+{
+    slots_.reserve(n);
+}
+
+/**
+ * Rewrites the node array in depth-first pre-order without its free
+ * slots and at exactly its size, so that a lookup touches the top levels
+ * of the tree in a few adjacent cache lines and removed entries stop
+ * holding memory.
+ *
+ * Invalidates all iterators. Returns the bytes of array given back.
+ */
+template<class Key, class Value>
+size_t CompactAVLTree<Key, Value>::compact()
+{
+    size_t before = slots_.capacity() * sizeof(Slot);
+    std::vector<Slot> packed;
+    packed.reserve(size_);
+    std::vector<uint32_t> renumber(slots_.size());
+    std::vector<uint32_t> pending;
+    if (root_ != NIL) {
+        pending.push_back(root_);
+    }
+    while (!pending.empty()) {
+        uint32_t old = pending.back();
+        pending.pop_back();
+        renumber[old] = (uint32_t)packed.size();
+        packed.push_back(slots_[old]);
+        if (slots_[old].right != NIL) {
+            pending.push_back(slots_[old].right);
+        }
+        if (slots_[old].left != NIL) {
+            pending.push_back(slots_[old].left);
+        }
+    }
+    for (size_t i = 0; i < packed.size(); ++i) {
+        Slot& s = packed[i];
+        if (s.parent != NIL) {
+            s.parent = renumber[s.parent];
+        }
+        if (s.left != NIL) {
+            s.left = renumber[s.left];
+        }
+        if (s.right != NIL) {
+            s.right = renumber[s.right];
+        }
+    }
+    slots_.swap(packed);
+    root_ = slots_.empty() ? NIL : 0;
+    freeHead_ = NIL;
+    size_t after = slots_.capacity() * sizeof(Slot);
+    return before > after ? before - after : 0;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+    slots_.clear();
+    root_ = NIL;
+    freeHead_ = NIL;
+    size_ = 0;
+}
+
+/**
+ * Prints the contents in key order; there is no Node* tree to hand to
+ * printRoot().
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::print() const
+{
+    for (iterator it = begin(); it != end(); ++it) {
+        std::cout << '(' << it->first << ", " << it->second << ") ";
+    }
+    std::cout << "\n";
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::begin() const
+{
+    uint32_t current = root_;
+    while (current != NIL && slots_[current].left != NIL) {
+        current = slots_[current].left;
+    }
+    return iterator(this, current);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::end() const
+{
+    return iterator(this, NIL);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator CompactAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+ * Returns the value associated with the key, inserting a
+ * default-constructed value first if the key is missing.
+ */
+template<class Key, class Value>
+Value& CompactAVLTree<Key, Value>::operator[](const Key& key)
+{
+    uint32_t parent;
+    bool left;
+    uint32_t curr = locate(key, parent, left);
+    if (curr == NIL) curr = attach(parent, left, key, Value());
+    return slots_[curr].item.second;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value const & CompactAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    uint32_t curr = internalFind(key);
+    if (curr == NIL) throw std::out_of_range("Invalid key");
+    return slots_[curr].item.second;
+}
+
+/**
+ * Looks up count keys at once, writing find(keys[i]) to out[i]; keeps
+ * BST_FIND_MANY_INFLIGHT descents in flight as BinarySearchTree does,
+ * prefetching each one's next slot.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::find_many(const Key* keys, size_t count, iterator* out) const
+{
+    if (root_ == NIL) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = end();
+        }
+        return;
+    }
+
+    uint32_t nodes[BST_FIND_MANY_INFLIGHT];
+    size_t index[BST_FIND_MANY_INFLIGHT];
+    size_t slots = 0;
+    size_t next = 0;
+    while (slots < BST_FIND_MANY_INFLIGHT && next < count) {
+        nodes[slots] = root_;
+        index[slots++] = next++;
+    }
+
+    size_t active = slots;
+    while (active > 0) {
+        for (size_t s = 0; s < slots; ++s) {
+            uint32_t n = nodes[s];
+            if (n == NIL) {
+                continue;   // retired slot
+            }
+            const Key& k = keys[index[s]];
+            uint32_t child;
+            if (k < slots_[n].item.first) {
+                child = slots_[n].left;
+            } else if (slots_[n].item.first < k) {
+                child = slots_[n].right;
+            } else {
+                out[index[s]] = iterator(this, n);
+                child = NIL;
+                n = NIL;
+            }
+
+            if (child != NIL) {
+                BST_PREFETCH(&slots_[child]);
+                nodes[s] = child;
+                continue;
+            }
+            if (n != NIL) {
+                out[index[s]] = end();   // fell off a leaf: miss
+            }
+            if (next < count) {
+                nodes[s] = root_;
+                index[s] = next++;
+            } else {
+                nodes[s] = NIL;
+                active--;
+            }
+        }
+    }
+}
+
+/**
+ * Vector form of find_many(); out is resized to keys.size().
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::find_many(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.resize(keys.size());
+    if (!keys.empty()) {
+        find_many(&keys[0], keys.size(), &out[0]);
+    }
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    uint32_t current = root_;
+    while (current != NIL) {
+        const Slot& s = slots_[current];
+        if (key < s.item.first) {
+            current = s.left;
+        } else if (s.item.first < key) {
+            current = s.right;
+        } else {
+            return current;
+        }
+    }
+    return NIL;
+}
+
+/**
+ * Takes a slot from the free list, or appends one to the array.
+ */
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::allocSlot(const Key& key, const Value& value, uint32_t parent)
+{
+    size_++;
+    if (freeHead_ != NIL) {
+        uint32_t index = freeHead_;
+        freeHead_ = slots_[index].left;
+        rebuildSlot(index, Slot(key, value, parent));
+        return index;
+    }
+    if (slots_.size() >= NIL) {
+        size_--;
+        throw std::length_error("CompactAVLTree is full");
+    }
+    slots_.push_back(Slot(key, value, parent));
+    return (uint32_t)(slots_.size() - 1);
+}
+
+/**
+ * Replaces the slot at index with a copy of slot. A Slot's key is const,
+ * so it cannot be assigned; the old slot is destroyed first and the new
+ * one constructed in its storage.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rebuildSlot(uint32_t index, const Slot& slot)
+{
+    Slot* where = &slots_[index];
+    where->~Slot();
+    new (where) Slot(slot);
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::freeSlot(uint32_t index)
+{
+    size_--;
+    slots_[index].parent = NIL;
+    slots_[index].right = NIL;
+    slots_[index].left = freeHead_;
+    freeHead_ = index;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if (parent == NIL) {
+        root_ = newChild;
+    }
+    else if (slots_[parent].left == oldChild) {
+        slots_[parent].left = newChild;
+    }
+    else {
+        slots_[parent].right = newChild;
+    }
+    if (newChild != NIL) {
+        slots_[newChild].parent = parent;
+    }
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateLeft(uint32_t index)
+{
+    uint32_t nR = slots_[index].right;
+    uint32_t nL = slots_[nR].left;
+    replaceChild(slots_[index].parent, index, nR);
+    slots_[index].right = nL;
+    if (nL != NIL) {
+        slots_[nL].parent = index;
+    }
+    slots_[nR].left = index;
+    slots_[index].parent = nR;
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateRight(uint32_t index)
+{
+    uint32_t nL = slots_[index].left;
+    uint32_t nR = slots_[nL].right;
+    replaceChild(slots_[index].parent, index, nL);
+    slots_[index].left = nR;
+    if (nR != NIL) {
+        slots_[nR].parent = index;
+    }
+    slots_[nL].right = index;
+    slots_[index].parent = nL;
+}
+
+/**
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
+ */
+template<class Key, class Value>
+std::pair<typename CompactAVLTree<Key, Value>::iterator, bool>
+CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    uint32_t parent;
+    bool left;
+    uint32_t existing = locate(keyValuePair.first, parent, left);
+    if (existing != NIL) {
+        slots_[existing].item.second = keyValuePair.second;
+        return std::make_pair(iterator(this, existing), false);
+    }
+    return std::make_pair(iterator(this, attach(parent, left, keyValuePair.first, keyValuePair.second)), true);
+}
+
+/**
+ * Inserts factory() under key only if the key is missing; one descent.
+ */
+template<class Key, class Value>
+template<typename Factory>
+std::pair<typename CompactAVLTree<Key, Value>::iterator, bool>
+CompactAVLTree<Key, Value>::find_or_insert(const Key& key, Factory factory)
+{
+    uint32_t parent;
+    bool left;
+    uint32_t existing = locate(key, parent, left);
+    if (existing != NIL) {
+        return std::make_pair(iterator(this, existing), false);
+    }
+    return std::make_pair(iterator(this, attach(parent, left, key, factory())), true);
+}
+
+/**
+ * Returns the slot holding key, or NIL with parent/left set to where a
+ * new slot for key would hang.
+ */
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::locate(const Key& key, uint32_t& parent, bool& left) const
+{
+    uint32_t current = root_;
+    parent = NIL;
+    left = false;
+    while (current != NIL) {
+        if (key < slots_[current].item.first) {
+            parent = current;
+            left = true;
+            current = slots_[current].left;
+        } else if (slots_[current].item.first < key) {
+            parent = current;
+            left = false;
+            current = slots_[current].right;
+        } else {
+            return current;
+        }
+    }
+    return NIL;
+}
+
+/**
+ * Links a new slot under parent and retraces.
+ */
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::attach(uint32_t parent, bool left, const Key& key, const Value& value)
+{
+    uint32_t node = allocSlot(key, value, parent);
+    if (parent == NIL) {
+        root_ = node;
+    } else if (left) {
+        slots_[parent].left = node;
+    } else {
+        slots_[parent].right = node;
+    }
+    insertFix(node);
+    return node;
+}
+
+/**
+ * Walks up from a newly attached leaf, updating balances until a
+ * subtree's height stops growing or a single/double rotation fixes it.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::insertFix(uint32_t node)
+{
+    uint32_t parent = slots_[node].parent;
+    while (parent != NIL) {
+        Slot& p = slots_[parent];
+        p.balance += (node == p.left) ? -1 : 1;
+        if (p.balance == 0) {
+            return;
+        }
+        if (p.balance == 1 || p.balance == -1) {
+            node = parent;
+            parent = p.parent;
+            continue;
+        }
+
+        if (p.balance == -2) {
+            if (slots_[node].balance == -1) {
+                rotateRight(parent);
+                slots_[parent].balance = 0;
+                slots_[node].balance = 0;
+            }
+            else {
+                uint32_t g = slots_[node].right;
+                int8_t gb = slots_[g].balance;
+                rotateLeft(node);
+                rotateRight(parent);
+                slots_[parent].balance = (gb == -1) ? 1 : 0;
+                slots_[node].balance = (gb == 1) ? -1 : 0;
+                slots_[g].balance = 0;
+            }
+        }
+        else {
+            if (slots_[node].balance == 1) {
+                rotateLeft(parent);
+                slots_[parent].balance = 0;
+                slots_[node].balance = 0;
+            }
+            else {
+                uint32_t g = slots_[node].left;
+                int8_t gb = slots_[g].balance;
+                rotateRight(node);
+                rotateLeft(parent);
+                slots_[parent].balance = (gb == 1) ? -1 : 0;
+                slots_[node].balance = (gb == -1) ? 1 : 0;
+                slots_[g].balance = 0;
+            }
+        }
+        return;
+    }
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::remove(const Key& key)
+{
+    uint32_t target = internalFind(key);
+    if (target == NIL) return;
+    unlinkSlot(target);
+}
+
+/**
+* Removes the item at pos, which must be valid, and returns an iterator
+* to the key after it. The successor's slot never moves, so the result
+* holds even when the predecessor's item is moved into pos.
+*/
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::erase(iterator pos)
+{
+    iterator next = pos;
+    ++next;
+    unlinkSlot(pos.index_);
+    return next;
+}
+
+/**
+* Removes every key in [first, last) and returns last.
+*/
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::erase(iterator first, iterator last)
+{
+    while (first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+/**
+* Takes the key's item out of the tree, or returns an empty handle if
+* the key is missing.
+*/
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::node_type
+CompactAVLTree<Key, Value>::extract(const Key& key)
+{
+    uint32_t target = internalFind(key);
+    if (target == NIL) {
+        return node_type();
+    }
+    return extract(iterator(this, target));
+}
+
+/**
+* Takes the item at pos, which must be valid, out of the tree.
+*/
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::node_type
+CompactAVLTree<Key, Value>::extract(iterator pos)
+{
+    node_type handle(*pos);
+    unlinkSlot(pos.index_);
+    return handle;
+}
+
+/**
+* Inserts an extracted item. If the key is already present nothing
+* changes and the handle keeps its item.
+*/
+template<class Key, class Value>
+std::pair<typename CompactAVLTree<Key, Value>::iterator, bool>
+CompactAVLTree<Key, Value>::insert(node_type&& handle)
+{
+    if (handle.empty()) {
+        return std::make_pair(end(), false);
+    }
+    uint32_t parent;
+    bool left;
+    uint32_t existing = locate(handle.key(), parent, left);
+    if (existing != NIL) {
+        return std::make_pair(iterator(this, existing), false);
+    }
+    uint32_t node = attach(parent, left, handle.item_.first, handle.item_.second);
+    handle.full_ = false;
+    return std::make_pair(iterator(this, node), true);
+}
+
+/*
+ * Unlinks target and retraces. A node with two children takes its
+ * predecessor's item and the predecessor's slot is unlinked instead, so
+ * no links need swapping.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::unlinkSlot(uint32_t target)
+{
+    if (slots_[target].left != NIL && slots_[target].right != NIL) {
+        uint32_t pred = slots_[target].left;
+        while (slots_[pred].right != NIL) {
+            pred = slots_[pred].right;
+        }
+        const Slot& t = slots_[target];
+        Slot moved(slots_[pred].item.first, slots_[pred].item.second, t.parent);
+        moved.left = t.left;
+        moved.right = t.right;
+        moved.balance = t.balance;
+        rebuildSlot(target, moved);
+        target = pred;
+    }
+
+    uint32_t child = (slots_[target].left != NIL) ? slots_[target].left : slots_[target].right;
+    uint32_t parent = slots_[target].parent;
+    bool removedLeft = (parent != NIL && slots_[parent].left == target);
+    replaceChild(parent, target, child);
+    freeSlot(target);
+    removeFix(parent, removedLeft);
+}
+
+/**
+ * Retraces from the parent of an unlinked node whose subtree shrank by
+ * one level, rotating where needed and stopping once a height holds.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::removeFix(uint32_t parent, bool removedLeft)
+{
+    while (parent != NIL) {
+        Slot& p = slots_[parent];
+        p.balance += removedLeft ? 1 : -1;
+        uint32_t top = parent;
+
+        if (p.balance == 1 || p.balance == -1) {
+            return;
+        }
+        if (p.balance == 2) {
+            uint32_t s = p.right;
+            int8_t sb = slots_[s].balance;
+            if (sb >= 0) {
+                rotateLeft(parent);
+                if (sb == 0) {
+                    slots_[parent].balance = 1;
+                    slots_[s].balance = -1;
+                    return;
+                }
+                slots_[parent].balance = 0;
+                slots_[s].balance = 0;
+                top = s;
+            }
+            else {
+                uint32_t g = slots_[s].left;
+                int8_t gb = slots_[g].balance;
+                rotateRight(s);
+                rotateLeft(parent);
+                slots_[parent].balance = (gb == 1) ? -1 : 0;
+                slots_[s].balance = (gb == -1) ? 1 : 0;
+                slots_[g].balance = 0;
+                top = g;
+            }
+        }
+        else if (p.balance == -2) {
+            uint32_t s = p.left;
+            int8_t sb = slots_[s].balance;
+            if (sb <= 0) {
+                rotateRight(parent);
+                if (sb == 0) {
+                    slots_[parent].balance = -1;
+                    slots_[s].balance = 1;
+                    return;
+                }
+                slots_[parent].balance = 0;
+                slots_[s].balance = 0;
+                top = s;
+            }
+            else {
+                uint32_t g = slots_[s].right;
+                int8_t gb = slots_[g].balance;
+                rotateLeft(s);
+                rotateRight(parent);
+                slots_[parent].balance = (gb == -1) ? 1 : 0;
+                slots_[s].balance = (gb == 1) ? -1 : 0;
+                slots_[g].balance = 0;
+                top = g;
+            }
+        }
+
+        // the subtree rooted at top is one level shorter; keep going up
+        parent = slots_[top].parent;
+        removedLeft = (parent != NIL && slots_[parent].left == top);
+    }
+}
+
+/**
+ * Iterative post-order height check. Returns the tree height, or -2 if
+ * a link, ordering or balance invariant is broken. Stored balances are
+ * only compared when checkStored is set.
+ */
+template<class Key, class Value>
+int CompactAVLTree<Key, Value>::checkHeights(bool checkStored) const
+{
+    if (root_ == NIL) return -1;
+    if (slots_[root_].parent != NIL) return -2;
+
+    struct Frame {
+        uint32_t node;
+        int state;          // 0 = descend left, 1 = visit + descend right, 2 = finish
+        int leftHeight;
+    };
+
+    std::vector<Frame> stack;
+    Frame first = { root_, 0, -1 };
+    stack.push_back(first);
+    uint32_t prev = NIL;
+    int childHeight = -1;
+
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        const Slot& s = slots_[top.node];
+        if (top.state == 0) {
+            top.state = 1;
+            if (s.left != NIL) {
+                if (slots_[s.left].parent != top.node) return -2;
+                Frame f = { s.left, 0, -1 };
+                stack.push_back(f);
+            } else {
+                childHeight = -1;
+            }
+        }
+        else if (top.state == 1) {
+            top.state = 2;
+            top.leftHeight = childHeight;
+            if (prev != NIL && !(slots_[prev].item.first < s.item.first)) return -2;
+            prev = top.node;
+            if (s.right != NIL) {
+                if (slots_[s.right].parent != top.node) return -2;
+                Frame f = { s.right, 0, -1 };
+                stack.push_back(f);
+            } else {
+                childHeight = -1;
+            }
+        }
+        else {
+            int lh = top.leftHeight;
+            int rh = childHeight;
+            if (rh - lh < -1 || rh - lh > 1) return -2;
+            if (checkStored && s.balance != rh - lh) return -2;
+            childHeight = 1 + std::max(lh, rh);
+            stack.pop_back();
+        }
+    }
+    return childHeight;
+}
+
+/**
+ * Return true iff the tree is height balanced.
+ */
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::isBalanced() const
+{
+    return checkHeights(false) != -2;
+}
+
+/**
+ * Return true iff links, key order and every stored balance are correct.
+ */
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::validate() const
+{
+    return checkHeights(true) != -2;
+}
+
+#endif
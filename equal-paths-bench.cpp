@@ -0,0 +1,231 @@
+// equalPaths() throughput on large generated trees.
+//
+//   make equal-paths-bench
+//   ./equal-paths-bench [nodes] [threads]
+//
+// Trees are perfect, complete, random or degenerate (a left chain), and
+// are carved from one pooled array in one of two layouts: "preorder"
+// places nodes in the order the traversal visits them; "strided"
+// scatters consecutive nodes across the whole pool, like a long-lived
+// heap. Each check is timed
+// once right after flushing the caches (cold) and then as the best of
+// several repeats (warm); equalPaths(), equalPathsParallel() ("par")
+// and analyzeShape() each get both columns, in milliseconds. Up to 100M
+// nodes fit in about 2.4 GB.
+//
+// Complete and random trees usually fail early, so nodes/s is only shown
+// for trees that pass; analyzeShape() always visits every node.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "equal-paths.h"
+#include "tree-shape.h"
+#include "benchrand.h"
+
+using namespace std;
+
+enum Shape { PERFECT, COMPLETE, RANDOM, DEGENERATE };
+enum Layout { PREORDER, STRIDED };
+
+static const char* shapeNames[] = { "perfect", "complete", "random", "degenerate" };
+static const char* layoutNames[] = { "preorder", "strided" };
+
+static const size_t FLUSH_BYTES = 256 << 20;
+static const int WARM_RUNS = 3;
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * Fixed pool of nodes handed out in creation order, or scattered by a
+ * stride coprime to the pool size (so every slot is used once).
+ */
+class NodeArena
+{
+public:
+    NodeArena(size_t count, Layout layout) : nodes_(count, Node(0)), next_(0), stride_(1)
+    {
+        if (layout == STRIDED && count > 1) {
+            stride_ = count / 2 + 7919;
+            while (gcd(stride_, count) != 1) {
+                stride_++;
+            }
+        }
+    }
+
+    Node* make(int key)
+    {
+        Node* node = &nodes_[next_ * stride_ % nodes_.size()];
+        next_++;
+        node->key = key;
+        node->left = node->right = NULL;
+        return node;
+    }
+
+    size_t used() const { return next_; }
+
+private:
+    vector<Node> nodes_;
+    uint64_t next_;
+    uint64_t stride_;
+};
+
+/**
+ * Builds a tree of about n nodes in preorder with an explicit stack. Each
+ * pending subtree carries one number: levels left (perfect), heap index
+ * (complete) or node count (random, degenerate).
+ */
+static Node* build(Shape shape, size_t n, NodeArena& pool, uint64_t& seed)
+{
+    struct Pending {
+        Node** link;
+        uint64_t arg;
+    };
+
+    uint64_t levels = 0;
+    while ((uint64_t(2) << levels) - 1 <= n) {
+        levels++;
+    }
+
+    Node* root = NULL;
+    vector<Pending> stack;
+    Pending first = { &root, shape == PERFECT ? levels : shape == COMPLETE ? 1 : n };
+    stack.push_back(first);
+    while (!stack.empty()) {
+        Pending p = stack.back();
+        stack.pop_back();
+        Node* node = pool.make(int(pool.used()));
+        *p.link = node;
+
+        uint64_t left = 0, right = 0;
+        bool hasLeft = false, hasRight = false;
+        switch (shape) {
+        case PERFECT:
+            hasLeft = hasRight = p.arg > 1;
+            left = right = p.arg - 1;
+            break;
+        case COMPLETE:
+            left = 2 * p.arg;
+            right = left + 1;
+            hasLeft = left <= n;
+            hasRight = right <= n;
+            break;
+        case RANDOM:
+            left = nextRand(seed) % p.arg;
+            right = p.arg - 1 - left;
+            hasLeft = left > 0;
+            hasRight = right > 0;
+            break;
+        case DEGENERATE:
+            left = p.arg - 1;
+            hasLeft = left > 0;
+            break;
+        }
+        if (hasRight) {
+            Pending r = { &node->right, right };
+            stack.push_back(r);
+        }
+        if (hasLeft) {
+            Pending l = { &node->left, left };
+            stack.push_back(l);
+        }
+    }
+    return root;
+}
+
+static void flushCaches()
+{
+    static vector<char> junk(FLUSH_BYTES);
+    for (size_t i = 0; i < junk.size(); i += 64) {
+        junk[i]++;
+    }
+}
+
+template <typename Check>
+static void timeCheck(Check check, double& coldSec, double& warmSec)
+{
+    flushCaches();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    check();
+    coldSec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    warmSec = coldSec;
+    for (int i = 0; i < WARM_RUNS; ++i) {
+        start = chrono::steady_clock::now();
+        check();
+        warmSec = min(warmSec, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nodes = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    if (nodes == 0) {
+        cerr << "equal-paths-bench: node count must be at least 1" << endl;
+        return 1;
+    }
+    unsigned threads = argc > 2 ? atoi(argv[2]) : 0;
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
+    cout << "up to " << nodes << " nodes, " << threads << " threads for equalPathsParallel" << endl;
+    cout << setw(11) << "shape" << setw(10) << "layout" << setw(11) << "nodes" << setw(7) << "equal"
+         << setw(10) << "cold ms" << setw(10) << "warm ms" << setw(11) << "Mnodes/s"
+         << setw(10) << "par cold" << setw(10) << "par warm"
+         << setw(12) << "shape cold" << setw(12) << "shape warm" << setw(11) << "Mnodes/s" << endl;
+
+    for (int s = PERFECT; s <= DEGENERATE; ++s) {
+        for (int l = PREORDER; l <= STRIDED; ++l) {
+            uint64_t seed = 88172645463325252ull;
+            NodeArena pool(nodes, Layout(l));
+            Node* root = build(Shape(s), nodes, pool, seed);
+            size_t built = pool.used();
+
+            bool equal = false;
+            double coldSec, warmSec, parallelCold, parallelSec, shapeCold, shapeSec;
+            timeCheck([&]() { equal = equalPaths(root); }, coldSec, warmSec);
+            timeCheck([&]() {
+                if (equalPathsParallel(root, threads) != equal) {
+                    cerr << "equal-paths-bench: parallel check disagrees" << endl;
+                    exit(1);
+                }
+            }, parallelCold, parallelSec);
+            timeCheck([&]() {
+                if (analyzeShape(root).nodes != built) {
+                    cerr << "equal-paths-bench: analyzeShape miscounted" << endl;
+                    exit(1);
+                }
+            }, shapeCold, shapeSec);
+
+            cout << setw(11) << shapeNames[s] << setw(10) << layoutNames[l] << setw(11) << built
+                 << setw(7) << (equal ? "yes" : "no") << fixed << setprecision(1)
+                 << setw(10) << coldSec * 1e3 << setw(10) << warmSec * 1e3
+                 << setw(11);
+            if (equal) {
+                cout << built / warmSec / 1e6;
+            }
+            else {
+                cout << "-";
+            }
+            cout << setw(10) << parallelCold * 1e3 << setw(10) << parallelSec * 1e3
+                 << setw(12) << shapeCold * 1e3 << setw(12) << shapeSec * 1e3
+                 << setw(11) << built / shapeSec / 1e6 << endl;
+        }
+    }
+    return 0;
+}
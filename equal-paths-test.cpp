@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include "equal-paths.h"
+#include "tree-shape.h"
 using namespace std;
 
 
@@ -55,6 +57,19 @@ void test5(const char* msg)
   cout << msg << ": " <<   equalPaths(a) << endl;
 }
 
+void test6(const char* msg)
+{
+  // a million-node chain would overflow a recursive check
+  const int n = 1000000;
+  vector<Node> chain(n, Node(0));
+  for(int i = 0; i < n; i++) {
+    setNode(&chain[i], i, i + 1 < n ? &chain[i + 1] : NULL, NULL);
+  }
+  TreeShape shape = analyzeShape(&chain[0]);
+  cout << msg << ": " << equalPaths(&chain[0]) << " " << equalPathsParallel(&chain[0])
+       << " (height " << shape.height << ", path length " << shape.internalPathLength << ")" << endl;
+}
+
 int main()
 {
   a = new Node(1);
@@ -67,6 +82,7 @@ int main()
   test3("Test3");
   test4("Test4");
   test5("Test5");
+  test6("Test6");
  
   delete a;
   delete b;
@@ -1,6 +1,8 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
 #include <iostream>
+#include <vector>
+#include <utility>
 #endif
 
 #include "equal-paths.h"
@@ -18,16 +20,36 @@ bool equalPaths(Node * root)
     return checkEqualPaths(root, leafDepth, 0);
 }
 
+// Checks the subtree at node (which sits at currentDepth) against
+// leafDepth, the depth of the first leaf seen so far or -1. Uses an
+// explicit stack so degenerate trees cannot overflow the call stack, and
+// stops at the first leaf at another depth or the first internal node at
+// or below leafDepth, whose leaves must be deeper still.
 bool checkEqualPaths(Node* node, int& leafDepth, int currentDepth) {
     if (!node) return true; 
 
-    if (!node->left && !node->right) {
-        if (leafDepth == -1) {
-            leafDepth = currentDepth; 
-            return true;
+    vector<pair<Node*, int> > stack;
+    stack.push_back(make_pair(node, currentDepth));
+    while (!stack.empty()) {
+        Node* curr = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        if (!curr->left && !curr->right) {
+            if (leafDepth == -1) {
+                leafDepth = depth;
+            }
+            else if (leafDepth != depth) {
+                return false;
+            }
+            continue;
         }
-        return leafDepth == currentDepth; 
+        if (leafDepth != -1 && depth >= leafDepth) {
+            return false;
+        }
+        // left on top, so the first leaf found is the leftmost one
+        if (curr->right) stack.push_back(make_pair(curr->right, depth + 1));
+        if (curr->left) stack.push_back(make_pair(curr->left, depth + 1));
     }
-
-    return checkEqualPaths(node->left, leafDepth, currentDepth + 1) && checkEqualPaths(node->right, leafDepth, currentDepth + 1);
-}
\ No newline at end of file
+    return true;
+}
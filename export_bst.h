@@ -0,0 +1,502 @@
+#ifndef EXPORT_BST_H
+#define EXPORT_BST_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include "bst.h"
+
+// Tree dumps for offline analysis. Unlike printRoot(), these write to any
+// std::ostream, have no height limit and make a single O(n) pass that
+// walks parent pointers, so neither the stack nor the heap grows with
+// the tree (DOT and flat JSON keep one id per level).
+
+enum ExportFormat
+{
+    EXPORT_DOT,         // Graphviz digraph
+    EXPORT_JSON,        // nested {"key", "value", "left", "right"} objects
+    EXPORT_JSON_FLAT,   // {"nodes": [...]} of {"id", "parent", "side", ...}
+    EXPORT_TEXT         // one line per node, starting with its depth
+};
+
+/**
+ * Limits for exportTree(). Children cut off by either limit are written
+ * as a "..." marker so that a partial dump is never mistaken for a leaf.
+ */
+struct ExportOptions
+{
+    size_t maxDepth;    // deepest level written; the start node is level 0
+    size_t maxNodes;    // nodes written before the rest is cut off
+    bool values;        // write values as well as keys
+
+    ExportOptions() :
+        maxDepth(std::numeric_limits<size_t>::max()),
+        maxNodes(std::numeric_limits<size_t>::max()),
+        values(true)
+    {
+
+    }
+};
+
+/**
+ * Receives the walk of ExportWalk in pre-order: open() for each node
+ * written, truncated() for each child left out, close() once a node's
+ * children are done. side is 'L', 'R', or 0 for the start node.
+ */
+template <typename Key, typename Value>
+class ExportWriter
+{
+public:
+    virtual ~ExportWriter() {}
+    virtual void begin() {}
+    virtual void open(const Node<Key, Value>* node, size_t depth, char side) = 0;
+    virtual void truncated(size_t depth, char side) = 0;
+    virtual void close(const Node<Key, Value>* node, size_t depth) = 0;
+    virtual void end() {}
+};
+
+/**
+ * Writes item with operator<<, or as (first, second) for pairs.
+ */
+template <typename T>
+std::string exportItem(const T& item)
+{
+    std::ostringstream os;
+    ppbstPrintItem(os, item);
+    return os.str();
+}
+
+/**
+ * Escapes quotes, backslashes and control characters for DOT and JSON
+ * string literals.
+ */
+inline std::string exportEscape(const std::string& text)
+{
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n') {
+            out += "\\n";
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        }
+        else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+/**
+ * Numbers are written as JSON numbers, everything else (characters
+ * included) as strings.
+ */
+template <typename T>
+struct ExportAsNumber : std::integral_constant<bool,
+    std::is_arithmetic<T>::value && !std::is_same<T, char>::value &&
+    !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value &&
+    !std::is_same<T, bool>::value>
+{
+};
+
+template <typename T>
+void exportJsonItem(std::ostream& os, const T& item, std::true_type)
+{
+    os << item;
+}
+
+template <typename T>
+void exportJsonItem(std::ostream& os, const T& item, std::false_type)
+{
+    os << '"' << exportEscape(exportItem(item)) << '"';
+}
+
+template <typename Key, typename Value>
+class DotExportWriter : public ExportWriter<Key, Value>
+{
+public:
+    DotExportWriter(std::ostream& os, bool values) : os_(os), values_(values), next_(0) {}
+
+    virtual void begin() override
+    {
+        os_ << "digraph bst {\n    node [shape=box];\n";
+    }
+
+    virtual void open(const Node<Key, Value>* node, size_t depth, char side) override
+    {
+        size_t id = next_++;
+        os_ << "    n" << id << " [label=\"" << exportEscape(exportItem(node->getKey()));
+        if (values_) {
+            os_ << "\\n" << exportEscape(exportItem(node->getValue()));
+        }
+        os_ << "\"];\n";
+        edge(depth, side, id);
+        ids_.resize(depth + 1);
+        ids_[depth] = id;
+    }
+
+    virtual void truncated(size_t depth, char side) override
+    {
+        size_t id = next_++;
+        os_ << "    n" << id << " [label=\"...\", shape=plaintext];\n";
+        edge(depth, side, id);
+    }
+
+    virtual void close(const Node<Key, Value>*, size_t) override {}
+
+    virtual void end() override
+    {
+        os_ << "}\n";
+    }
+
+protected:
+    void edge(size_t depth, char side, size_t id)
+    {
+        if (depth > 0) {
+            os_ << "    n" << ids_[depth - 1] << " -> n" << id << " [label=" << side << "];\n";
+        }
+    }
+
+    std::ostream& os_;
+    bool values_;
+    size_t next_;
+    std::vector<size_t> ids_;   // id of the open node at each level
+};
+
+/**
+ * Nests one object per level, so a degenerate tree nests as deep as it
+ * is tall; many JSON parsers stop at a depth of a few hundred to a few
+ * thousand. EXPORT_JSON_FLAT writes the same tree at depth 2.
+ */
+template <typename Key, typename Value>
+class JsonExportWriter : public ExportWriter<Key, Value>
+{
+public:
+    JsonExportWriter(std::ostream& os, bool values) : os_(os), values_(values) {}
+
+    virtual void open(const Node<Key, Value>* node, size_t, char side) override
+    {
+        child(side);
+        os_ << "{\"key\":";
+        exportJsonItem(os_, node->getKey(), ExportAsNumber<Key>());
+        if (values_) {
+            os_ << ",\"value\":";
+            exportJsonItem(os_, node->getValue(), ExportAsNumber<Value>());
+        }
+    }
+
+    virtual void truncated(size_t, char side) override
+    {
+        child(side);
+        os_ << "\"...\"";
+    }
+
+    virtual void close(const Node<Key, Value>*, size_t) override
+    {
+        os_ << '}';
+    }
+
+    virtual void end() override
+    {
+        os_ << '\n';
+    }
+
+protected:
+    void child(char side)
+    {
+        if (side == 'L') {
+            os_ << ",\"left\":";
+        }
+        else if (side == 'R') {
+            os_ << ",\"right\":";
+        }
+    }
+
+    std::ostream& os_;
+    bool values_;
+};
+
+/**
+ * One object per node in pre-order, linked to its parent by id. The root
+ * has a null parent and side; a child left out by a limit is written
+ * with "truncated": true and no key.
+ */
+template <typename Key, typename Value>
+class FlatJsonExportWriter : public ExportWriter<Key, Value>
+{
+public:
+    FlatJsonExportWriter(std::ostream& os, bool values) : os_(os), values_(values), next_(0) {}
+
+    virtual void begin() override
+    {
+        os_ << "{\"nodes\":[";
+    }
+
+    virtual void open(const Node<Key, Value>* node, size_t depth, char side) override
+    {
+        size_t id = item(depth, side);
+        os_ << ",\"key\":";
+        exportJsonItem(os_, node->getKey(), ExportAsNumber<Key>());
+        if (values_) {
+            os_ << ",\"value\":";
+            exportJsonItem(os_, node->getValue(), ExportAsNumber<Value>());
+        }
+        os_ << '}';
+        ids_.resize(depth + 1);
+        ids_[depth] = id;
+    }
+
+    virtual void truncated(size_t depth, char side) override
+    {
+        item(depth, side);
+        os_ << ",\"truncated\":true}";
+    }
+
+    virtual void close(const Node<Key, Value>*, size_t) override {}
+
+    virtual void end() override
+    {
+        os_ << "]}\n";
+    }
+
+protected:
+    // Writes the opening of an entry up to its side and returns its id.
+    size_t item(size_t depth, char side)
+    {
+        size_t id = next_++;
+        if (id > 0) {
+            os_ << ',';
+        }
+        os_ << "{\"id\":" << id << ",\"parent\":";
+        if (depth > 0) {
+            os_ << ids_[depth - 1] << ",\"side\":\"" << side << '"';
+        }
+        else {
+            os_ << "null,\"side\":null";
+        }
+        return id;
+    }
+
+    std::ostream& os_;
+    bool values_;
+    size_t next_;
+    std::vector<size_t> ids_;   // id of the open node at each level
+};
+
+/**
+ * Writes "<depth> <side>: key -> value" per node. The depth is a number
+ * rather than indentation, so that the dump stays O(n) bytes however
+ * deep the tree is.
+ */
+template <typename Key, typename Value>
+class TextExportWriter : public ExportWriter<Key, Value>
+{
+public:
+    TextExportWriter(std::ostream& os, bool values) : os_(os), values_(values) {}
+
+    virtual void open(const Node<Key, Value>* node, size_t depth, char side) override
+    {
+        prefix(depth, side);
+        ppbstPrintItem(os_, node->getKey());
+        if (values_) {
+            os_ << " -> ";
+            ppbstPrintItem(os_, node->getValue());
+        }
+        os_ << '\n';
+    }
+
+    virtual void truncated(size_t depth, char side) override
+    {
+        prefix(depth, side);
+        os_ << "...\n";
+    }
+
+    virtual void close(const Node<Key, Value>*, size_t) override {}
+
+protected:
+    void prefix(size_t depth, char side)
+    {
+        os_ << depth << ' ';
+        if (side != 0) {
+            os_ << side << ": ";
+        }
+    }
+
+    std::ostream& os_;
+    bool values_;
+};
+
+/**
+ * Drives an ExportWriter over a subtree in pre-order. Walks parent
+ * pointers, deciding what to do at each node from where it came from,
+ * so it needs no recursion and no stack.
+ */
+template <typename Key, typename Value>
+class ExportWalk
+{
+public:
+    static size_t run(const Node<Key, Value>* start, ExportWriter<Key, Value>& writer, const ExportOptions& options);
+    static const Node<Key, Value>* root(const BinarySearchTree<Key, Value>& tree);
+};
+
+template<class Key, class Value>
+const Node<Key, Value>* ExportWalk<Key, Value>::root(const BinarySearchTree<Key, Value>& tree)
+{
+    return tree.root_;
+}
+
+/**
+ * Returns the number of nodes written.
+ */
+template<class Key, class Value>
+size_t ExportWalk<Key, Value>::run(const Node<Key, Value>* start, ExportWriter<Key, Value>& writer, const ExportOptions& options)
+{
+    size_t written = 0;
+    writer.begin();
+    if (start == NULL || options.maxNodes == 0) {
+        if (start != NULL) {
+            writer.truncated(0, 0);
+        }
+        writer.end();
+        return 0;
+    }
+
+    const Node<Key, Value>* node = start;
+    const Node<Key, Value>* prev = NULL;
+    size_t depth = 0;
+    char side = 0;
+    while (true) {
+        const Node<Key, Value>* left = node->getLeft();
+        const Node<Key, Value>* right = node->getRight();
+        bool open = written < options.maxNodes && depth < options.maxDepth;
+        const Node<Key, Value>* next = NULL;
+
+        if (prev == NULL || (prev != left && prev != right)) {
+            // arrived from above
+            writer.open(node, depth, side);
+            written++;
+            open = written < options.maxNodes && depth < options.maxDepth;
+            if (left != NULL) {
+                if (open) {
+                    next = left;
+                    side = 'L';
+                }
+                else {
+                    writer.truncated(depth + 1, 'L');
+                }
+            }
+            if (next == NULL && right != NULL) {
+                if (open) {
+                    next = right;
+                    side = 'R';
+                }
+                else {
+                    writer.truncated(depth + 1, 'R');
+                }
+            }
+        }
+        else if (prev == left && right != NULL) {
+            if (open) {
+                next = right;
+                side = 'R';
+            }
+            else {
+                writer.truncated(depth + 1, 'R');
+            }
+        }
+
+        if (next != NULL) {
+            prev = node;
+            node = next;
+            depth++;
+            continue;
+        }
+
+        // node and its subtree are done
+        writer.close(node, depth);
+        if (node == start) {
+            break;
+        }
+        prev = node;
+        node = node->getParent();
+        depth--;
+    }
+    writer.end();
+    return written;
+}
+
+/**
+ * Writes the subtree at start in the given format. Returns the number of
+ * nodes written, which is less than the subtree's size if a limit cut it.
+ */
+template <typename Key, typename Value>
+size_t exportNodes(const Node<Key, Value>* start, std::ostream& os, ExportFormat format,
+                   const ExportOptions& options = ExportOptions())
+{
+    if (format == EXPORT_DOT) {
+        DotExportWriter<Key, Value> writer(os, options.values);
+        return ExportWalk<Key, Value>::run(start, writer, options);
+    }
+    if (format == EXPORT_JSON) {
+        JsonExportWriter<Key, Value> writer(os, options.values);
+        if (start == NULL) {
+            os << "null\n";
+            return 0;
+        }
+        return ExportWalk<Key, Value>::run(start, writer, options);
+    }
+    if (format == EXPORT_JSON_FLAT) {
+        FlatJsonExportWriter<Key, Value> writer(os, options.values);
+        return ExportWalk<Key, Value>::run(start, writer, options);
+    }
+    TextExportWriter<Key, Value> writer(os, options.values);
+    if (start == NULL) {
+        os << "<empty tree>\n";
+        return 0;
+    }
+    return ExportWalk<Key, Value>::run(start, writer, options);
+}
+
+/**
+ * Writes the whole tree.
+ */
+template <typename Key, typename Value>
+size_t exportTree(const BinarySearchTree<Key, Value>& tree, std::ostream& os, ExportFormat format,
+                  const ExportOptions& options = ExportOptions())
+{
+    return exportNodes(ExportWalk<Key, Value>::root(tree), os, format, options);
+}
+
+/**
+ * Writes only the subtree rooted at the node holding key; writes an empty
+ * dump if key is absent.
+ */
+template <typename Key, typename Value>
+size_t exportSubtree(const BinarySearchTree<Key, Value>& tree, const Key& key, std::ostream& os,
+                     ExportFormat format, const ExportOptions& options = ExportOptions())
+{
+    const Node<Key, Value>* node = ExportWalk<Key, Value>::root(tree);
+    while (node != NULL) {
+        if (key < node->getKey()) {
+            node = node->getLeft();
+        }
+        else if (node->getKey() < key) {
+            node = node->getRight();
+        }
+        else {
+            break;
+        }
+    }
+    return exportNodes(node, os, format, options);
+}
+
+#endif
@@ -0,0 +1,81 @@
+// find() on AVLTree vs. FilteredAVLTree as the share of misses grows.
+//
+//   make filter-bench
+//   ./filter-bench [size] [lookups]
+//
+// Present keys are even, absent keys odd, both drawn uniformly, and keys
+// are inserted in random order so nodes are scattered across the heap.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "filteredavl.h"
+#include "benchrand.h"
+
+using namespace std;
+
+template <typename Tree>
+static double timeFinds(const Tree& tree, const vector<uint64_t>& probes, size_t& hits)
+{
+    hits = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        hits += tree.find(probes[i]) != tree.end();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t size = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+
+    AVLTree<uint64_t, uint64_t> plain;
+    FilteredAVLTree<uint64_t, uint64_t> filtered(size);
+    uint64_t state = 88172645463325252ull;
+    vector<uint64_t> keys;
+    while (plain.size() < size) {
+        uint64_t k = nextRand(state) % (size * 4) * 2;
+        if (plain.insert(make_pair(k, k)).second) {
+            filtered.insert(make_pair(k, k));
+            keys.push_back(k);
+        }
+    }
+
+    cout << size << " keys, " << lookups << " lookups, filter "
+         << filtered.filterBytes() / 1024 << " KiB" << endl;
+    cout << setw(8) << "miss %" << setw(12) << "plain ns" << setw(14) << "filtered ns"
+         << setw(10) << "speedup" << setw(10) << "fp %" << endl;
+
+    const double missRatios[] = { 0.0, 0.3, 0.5, 0.7, 0.9, 0.99 };
+    for (size_t r = 0; r < sizeof(missRatios) / sizeof(missRatios[0]); ++r) {
+        vector<uint64_t> probes(lookups);
+        for (size_t i = 0; i < lookups; ++i) {
+            if (double(nextRand(state) % 10000) / 10000 < missRatios[r]) {
+                probes[i] = nextRand(state) % (size * 4) * 2 + 1;
+            }
+            else {
+                probes[i] = keys[nextRand(state) % keys.size()];
+            }
+        }
+
+        size_t plainHits, filteredHits;
+        double plainSec = timeFinds(plain, probes, plainHits);
+        filtered.resetStats();
+        double filteredSec = timeFinds(filtered, probes, filteredHits);
+        if (plainHits != filteredHits) {
+            cerr << "filter-bench: filtered tree missed a present key" << endl;
+            return 1;
+        }
+
+        cout << setw(8) << fixed << setprecision(0) << missRatios[r] * 100
+             << setw(12) << setprecision(1) << plainSec * 1e9 / lookups
+             << setw(14) << filteredSec * 1e9 / lookups
+             << setw(10) << setprecision(2) << plainSec / filteredSec
+             << setw(10) << setprecision(3) << filtered.stats().falsePositiveRate() * 100 << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef FILTEREDAVL_H
+#define FILTEREDAVL_H
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "avlbst.h"
+#include "hashmix.h"
+
+// Counters reserved per expected key, and counters bumped per key. All of
+// a key's counters sit in one 64-counter block, i.e. one cache line.
+#define FILTER_COUNTERS_PER_KEY 16
+#define FILTER_PROBES 6
+
+/**
+ * Lookup counts kept by FilteredAVLTree::find(), as a snapshot.
+ */
+struct FilterStats
+{
+    size_t lookups;         // calls to find()
+    size_t rejected;        // misses answered by the filter alone
+    size_t falsePositives;  // filter said maybe, tree said no
+
+    FilterStats() : lookups(0), rejected(0), falsePositives(0) {}
+
+    /**
+     * Share of absent keys the filter failed to reject.
+     */
+    double falsePositiveRate() const
+    {
+        size_t misses = rejected + falsePositives;
+        return misses == 0 ? 0.0 : double(falsePositives) / misses;
+    }
+};
+
+/**
+ * An AVLTree with a blocked counting Bloom filter in front of find(), so
+ * that most misses cost one hash and one cache line instead of a full
+ * root-to-leaf walk.
+ *
+ * Every node linked into or unlinked from the tree bumps or drops the
+ * key's counters, whichever path (insert, remove, erase, extract, node
+ * adoption) did it. Counters that reach 255 stick there and are never
+ * decremented, which can only cost false positives. The filter is rebuilt
+ * at twice the capacity when the tree outgrows it; rebuildFilter() also
+ * clears stuck counters after heavy churn.
+ *
+ * Only find(key) consults the filter; operator[], lower_bound() and the
+ * hinted overloads go straight to the tree. find() counts into relaxed
+ * atomics, so it is as safe to call from several threads at once as
+ * AVLTree::find().
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class FilteredAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    explicit FilteredAVLTree(size_t expectedKeys = 1024);
+    virtual ~FilteredAVLTree();
+
+    using AVLTree<Key, Value>::find;
+    iterator find(const Key& key) const;
+    bool mayContain(const Key& key) const;
+
+    void rebuildFilter();
+    FilterStats stats() const;
+    void resetStats();
+    size_t filterBytes() const;
+
+protected:
+    static const size_t BLOCK_COUNTERS = 64;
+
+    virtual Node<Key, Value>* linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* unlinkNode(Node<Key, Value>* node) override;
+    virtual void clearHelper(Node<Key, Value>* node) override;
+    virtual size_t auxiliaryBytes() const override;
+
+    uint64_t hashKey(const Key& key) const;
+    size_t blockOffset(uint64_t h) const;
+    void resize(size_t capacity);
+    void addKey(const Key& key);
+    void dropKey(const Key& key);
+
+    Hash hash_;
+    std::vector<uint8_t> counters_;
+    size_t blocks_;
+    size_t capacity_;
+    mutable std::atomic<size_t> lookups_;
+    mutable std::atomic<size_t> rejected_;
+    mutable std::atomic<size_t> falsePositives_;
+};
+
+template<class Key, class Value, class Hash>
+FilteredAVLTree<Key, Value, Hash>::FilteredAVLTree(size_t expectedKeys) :
+    blocks_(0), capacity_(0), lookups_(0), rejected_(0), falsePositives_(0)
+{
+    resize(expectedKeys);
+}
+
+template<class Key, class Value, class Hash>
+FilteredAVLTree<Key, Value, Hash>::~FilteredAVLTree()
+{
+
+}
+
+/**
+ * Mixes the user hash (often the identity for integers) so that block
+ * and probe bits are independent.
+ */
+template<class Key, class Value, class Hash>
+uint64_t FilteredAVLTree<Key, Value, Hash>::hashKey(const Key& key) const
+{
+    return mixHash(static_cast<uint64_t>(hash_(key)));
+}
+
+/**
+ * Where the block for hash h starts. The low 6 * FILTER_PROBES bits
+ * pick the counters within the block, so the block comes from the bits
+ * above them; the 28 left over cover far more blocks than fit in memory.
+ */
+template<class Key, class Value, class Hash>
+size_t FilteredAVLTree<Key, Value, Hash>::blockOffset(uint64_t h) const
+{
+    return (h >> (6 * FILTER_PROBES)) % blocks_ * BLOCK_COUNTERS;
+}
+
+/**
+ * False means key is certainly absent. The high hash bits pick the
+ * block and the low bits pick FILTER_PROBES counters in it.
+ */
+template<class Key, class Value, class Hash>
+bool FilteredAVLTree<Key, Value, Hash>::mayContain(const Key& key) const
+{
+    uint64_t h = hashKey(key);
+    const uint8_t* block = &counters_[blockOffset(h)];
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        if (block[(h >> (6 * i)) & (BLOCK_COUNTERS - 1)] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::addKey(const Key& key)
+{
+    uint64_t h = hashKey(key);
+    uint8_t* block = &counters_[blockOffset(h)];
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        uint8_t& counter = block[(h >> (6 * i)) & (BLOCK_COUNTERS - 1)];
+        if (counter != UINT8_MAX) {
+            counter++;
+        }
+    }
+}
+
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::dropKey(const Key& key)
+{
+    uint64_t h = hashKey(key);
+    uint8_t* block = &counters_[blockOffset(h)];
+    for (int i = 0; i < FILTER_PROBES; ++i) {
+        uint8_t& counter = block[(h >> (6 * i)) & (BLOCK_COUNTERS - 1)];
+        if (counter != UINT8_MAX) {
+            counter--;
+        }
+    }
+}
+
+/**
+ * Sizes the filter for capacity keys and refills it from the tree.
+ */
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::resize(size_t capacity)
+{
+    capacity_ = std::max<size_t>(capacity, 1);
+    blocks_ = (capacity_ * FILTER_COUNTERS_PER_KEY + BLOCK_COUNTERS - 1) / BLOCK_COUNTERS;
+    counters_.assign(blocks_ * BLOCK_COUNTERS, 0);
+    // not begin(), which a trace would log as a scan
+    for (iterator it = this->iteratorFor(this->getSmallestNode()); it != this->end(); ++it) {
+        addKey(it->first);
+    }
+}
+
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::rebuildFilter()
+{
+    resize(std::max(capacity_, this->size_));
+}
+
+template<class Key, class Value, class Hash>
+typename FilteredAVLTree<Key, Value, Hash>::iterator
+FilteredAVLTree<Key, Value, Hash>::find(const Key& key) const
+{
+    lookups_.fetch_add(1, std::memory_order_relaxed);
+    if (!mayContain(key)) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        this->traceOp(TRACE_FIND, key);
+        return this->end();
+    }
+    iterator it = AVLTree<Key, Value>::find(key);
+    if (it == this->end()) {
+        falsePositives_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return it;
+}
+
+template<class Key, class Value, class Hash>
+FilterStats FilteredAVLTree<Key, Value, Hash>::stats() const
+{
+    FilterStats stats;
+    stats.lookups = lookups_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.falsePositives = falsePositives_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::resetStats()
+{
+    lookups_.store(0, std::memory_order_relaxed);
+    rejected_.store(0, std::memory_order_relaxed);
+    falsePositives_.store(0, std::memory_order_relaxed);
+}
+
+template<class Key, class Value, class Hash>
+size_t FilteredAVLTree<Key, Value, Hash>::filterBytes() const
+{
+    return counters_.size();
+}
+
+/**
+ * Every insertion path, fresh node or adopted, ends here.
+ */
+template<class Key, class Value, class Hash>
+Node<Key, Value>* FilteredAVLTree<Key, Value, Hash>::linkNode(Node<Key, Value>* parent, bool left, Node<Key, Value>* node)
+{
+    Node<Key, Value>* linked = AVLTree<Key, Value>::linkNode(parent, left, node);
+    if (this->size_ > capacity_) {
+        resize(capacity_ * 2);
+    }
+    else {
+        addKey(linked->getKey());
+    }
+    return linked;
+}
+
+template<class Key, class Value, class Hash>
+Node<Key, Value>* FilteredAVLTree<Key, Value, Hash>::unlinkNode(Node<Key, Value>* node)
+{
+    Node<Key, Value>* unlinked = AVLTree<Key, Value>::unlinkNode(node);
+    dropKey(unlinked->getKey());
+    return unlinked;
+}
+
+template<class Key, class Value, class Hash>
+void FilteredAVLTree<Key, Value, Hash>::clearHelper(Node<Key, Value>* node)
+{
+    AVLTree<Key, Value>::clearHelper(node);
+    counters_.assign(counters_.size(), 0);
+}
+
+template<class Key, class Value, class Hash>
+size_t FilteredAVLTree<Key, Value, Hash>::auxiliaryBytes() const
+{
+    return counters_.capacity();
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Batched find_many() vs. a loop of find() on trees larger than the LLC,
+// and cursor seeks vs. find() for a stream of nearby keys.
+//
+//   make find-many-bench
+//   ./find-many-bench [batch] [lookups] [size ...]
+//
+// Keys are inserted in random order so that nodes end up scattered
+// across the heap, as they are after long uptime. The nearby stream is a
+// random walk moving up to NEAR_STEP keys (about half as many ranks) per
+// lookup.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+#include "benchrand.h"
+
+using namespace std;
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static const uint64_t NEAR_STEP = 16;
+
+int main(int argc, char* argv[])
+{
+    size_t batch = argc > 1 ? strtoull(argv[1], NULL, 10) : 256;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+    vector<uint64_t> sizes;
+    for (int i = 3; i < argc; ++i) {
+        sizes.push_back(strtoull(argv[i], NULL, 10));
+    }
+    if (sizes.empty()) {
+        sizes.push_back(1 << 14);
+        sizes.push_back(1 << 20);
+        sizes.push_back(1 << 23);
+    }
+
+    cout << "batch " << batch << ", " << lookups << " lookups per size" << endl;
+    cout << setw(10) << "size" << setw(14) << "find ns/op" << setw(18) << "find_many ns/op" << setw(10) << "speedup"
+         << setw(16) << "near find ns" << setw(14) << "cursor ns" << setw(10) << "speedup" << endl;
+
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        uint64_t n = sizes[s];
+        Tree tree;
+        uint64_t state = 104;
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t k = nextRand(state) % (n * 2);
+            tree.insert(make_pair(k, k));
+        }
+
+        // about half the probes miss
+        vector<uint64_t> keys(lookups);
+        for (size_t i = 0; i < lookups; ++i) {
+            keys[i] = nextRand(state) % (n * 2);
+        }
+
+        uint64_t hits = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; ++i) {
+            if (tree.find(keys[i]) != tree.end()) hits++;
+        }
+        double loopNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        uint64_t batchHits = 0;
+        vector<Tree::iterator> out(batch);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; i += batch) {
+            size_t count = min(batch, lookups - i);
+            tree.find_many(&keys[i], count, &out[0]);
+            for (size_t j = 0; j < count; ++j) {
+                if (out[j] != tree.end()) batchHits++;
+            }
+        }
+        double batchNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        if (hits != batchHits) {
+            cerr << "find-many-bench: find and find_many disagree" << endl;
+            return 1;
+        }
+
+        uint64_t pos = n;
+        for (size_t i = 0; i < lookups; ++i) {
+            uint64_t step = nextRand(state) % (2 * NEAR_STEP + 1);
+            pos = pos + step < NEAR_STEP ? 0 : min(pos + step - NEAR_STEP, n * 2 - 1);
+            keys[i] = pos;
+        }
+
+        uint64_t nearHits = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; ++i) {
+            if (tree.find(keys[i]) != tree.end()) nearHits++;
+        }
+        double nearNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        uint64_t cursorHits = 0;
+        Tree::cursor cursor(tree);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; ++i) {
+            if (cursor.seek(keys[i]) != tree.end()) cursorHits++;
+        }
+        double cursorNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        if (nearHits != cursorHits) {
+            cerr << "find-many-bench: find and cursor disagree" << endl;
+            return 1;
+        }
+        cout << setw(10) << n << fixed << setprecision(1)
+             << setw(14) << loopNs / lookups << setw(18) << batchNs / lookups
+             << setw(9) << setprecision(2) << loopNs / batchNs << "x"
+             << setw(16) << setprecision(1) << nearNs / lookups << setw(14) << cursorNs / lookups
+             << setw(9) << setprecision(2) << nearNs / cursorNs << "x" << endl;
+    }
+    return 0;
+}
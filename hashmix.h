@@ -0,0 +1,20 @@
+#ifndef HASHMIX_H
+#define HASHMIX_H
+
+#include <cstdint>
+
+/**
+ * The splitmix64 finalizer: spreads a hash that may be the identity (as
+ * std::hash is for integers on common libraries) over all 64 bits, so
+ * that any slice of the result is usable on its own.
+ */
+inline uint64_t mixHash(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+#endif
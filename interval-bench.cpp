@@ -0,0 +1,97 @@
+// IntervalTree overlap/stabbing queries vs. a linear scan with iterator.
+//
+//   make interval-bench
+//   ./interval-bench [intervals] [queries] [max-length]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "intervaltree.h"
+
+using namespace std;
+
+typedef IntervalTree<int64_t, int> Tree;
+
+static double elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    int queries = argc > 2 ? atoi(argv[2]) : 500;
+    int64_t maxLen = argc > 3 ? atoll(argv[3]) : 1000;
+    const int64_t span = (int64_t)n * 100;
+
+    srand(104);
+    Tree tree;
+    for (int i = 0; i < n; ++i) {
+        int64_t lo = (int64_t)rand() % span;
+        tree.insert(lo, lo + (int64_t)rand() % maxLen, i);
+    }
+
+    vector<pair<int64_t, int64_t> > windows(queries);
+    for (int i = 0; i < queries; ++i) {
+        int64_t lo = (int64_t)rand() % span;
+        windows[i] = make_pair(lo, lo + (int64_t)rand() % (maxLen * 4));
+    }
+
+    // overlap queries
+    uint64_t treeHits = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<Tree::iterator> out;
+    for (int i = 0; i < queries; ++i) {
+        out.clear();
+        tree.overlapping(windows[i].first, windows[i].second, out);
+        treeHits += out.size();
+    }
+    double treeMs = elapsedMs(start);
+
+    uint64_t scanHits = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        for (Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if (!(it->first.second < windows[i].first) && !(windows[i].second < it->first.first)) {
+                scanHits++;
+            }
+        }
+    }
+    double scanMs = elapsedMs(start);
+
+    // stabbing queries
+    uint64_t stabHits = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        if (tree.stab(windows[i].first) != tree.end()) stabHits++;
+    }
+    double stabMs = elapsedMs(start);
+
+    uint64_t stabScanHits = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        for (Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if (!(windows[i].first < it->first.first) && !(it->first.second < windows[i].first)) {
+                stabScanHits++;
+                break;
+            }
+        }
+    }
+    double stabScanMs = elapsedMs(start);
+
+    cout << n << " intervals, " << queries << " queries" << endl;
+    cout << fixed << setprecision(3);
+    cout << "overlap  tree " << setw(10) << treeMs / queries << " ms/query   scan "
+         << setw(10) << scanMs / queries << " ms/query   hits " << treeHits << endl;
+    cout << "stab     tree " << setw(10) << stabMs / queries << " ms/query   scan "
+         << setw(10) << stabScanMs / queries << " ms/query   hits " << stabHits << endl;
+
+    if (treeHits != scanHits || stabHits != stabScanHits) {
+        cerr << "interval-bench: tree and scan disagree" << endl;
+        return 1;
+    }
+    return 0;
+}
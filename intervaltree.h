@@ -0,0 +1,227 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "avlbst.h"
+
+/**
+ * An AVLNode keyed by a closed interval [first, second] that also
+ * stores the largest right endpoint anywhere in its subtree.
+ */
+template <typename Point, typename Value>
+class IntervalNode : public AVLNode<std::pair<Point, Point>, Value>
+{
+public:
+    IntervalNode(const std::pair<Point, Point>& key, const Value& value, AVLNode<std::pair<Point, Point>, Value>* parent);
+
+    const Point& getMaxEnd() const;
+    void setMaxEnd(const Point& maxEnd);
+
+protected:
+    Point maxEnd_;
+};
+
+template<class Point, class Value>
+IntervalNode<Point, Value>::IntervalNode(const std::pair<Point, Point>& key, const Value& value,
+                                         AVLNode<std::pair<Point, Point>, Value>* parent) :
+    AVLNode<std::pair<Point, Point>, Value>(key, value, parent), maxEnd_(key.second)
+{
+
+}
+
+template<class Point, class Value>
+const Point& IntervalNode<Point, Value>::getMaxEnd() const
+{
+    return maxEnd_;
+}
+
+template<class Point, class Value>
+void IntervalNode<Point, Value>::setMaxEnd(const Point& maxEnd)
+{
+    maxEnd_ = maxEnd;
+}
+
+/**
+ * An AVL tree of closed intervals, ordered by (start, end), answering
+ * overlap and stabbing queries without a full scan.
+ *
+ * Each node's max-endpoint is kept current through the AVLTree
+ * augmentation hooks: locally on every rotation, and along the changed
+ * path on insert/remove.
+ */
+template <typename Point, typename Value>
+class IntervalTree : public AVLTree<std::pair<Point, Point>, Value, VirtualAugment>
+{
+public:
+    typedef std::pair<Point, Point> Interval;
+    typedef typename AVLTree<Interval, Value, VirtualAugment>::iterator iterator;
+
+    using AVLTree<Interval, Value, VirtualAugment>::insert;
+    std::pair<iterator, bool> insert(const Point& lo, const Point& hi, const Value& value);
+
+    void overlapping(const Point& lo, const Point& hi, std::vector<iterator>& out) const;
+    iterator stab(const Point& point) const;
+
+protected:
+    virtual AVLNode<Interval, Value>* makeNode(const Interval& key, const Value& value, AVLNode<Interval, Value>* parent) override;
+    virtual void updateAugment(AVLNode<Interval, Value>* node) override;
+    virtual void updateAugmentPath(AVLNode<Interval, Value>* node) override;
+    virtual AVLNode<Interval, Value>* relocateNode(AVLNode<Interval, Value>* node, void* where) override;
+    virtual size_t nodeBytes() const override;
+    virtual const std::type_info& nodeType() const override;
+    virtual bool validateNode(Node<Interval, Value>* node, int leftHeight, int rightHeight) const override;
+
+    static IntervalNode<Point, Value>* asInterval(Node<Interval, Value>* node);
+};
+
+template<class Point, class Value>
+IntervalNode<Point, Value>* IntervalTree<Point, Value>::asInterval(Node<Interval, Value>* node)
+{
+    return static_cast<IntervalNode<Point, Value>*>(node);
+}
+
+/**
+ * Inserts [lo, hi]; an identical interval gets its value overwritten.
+ */
+template<class Point, class Value>
+std::pair<typename IntervalTree<Point, Value>::iterator, bool>
+IntervalTree<Point, Value>::insert(const Point& lo, const Point& hi, const Value& value)
+{
+    return this->insert(std::make_pair(std::make_pair(lo, hi), value));
+}
+
+/**
+ * Appends every interval intersecting [lo, hi], in key order.
+ * A subtree is skipped when its max-endpoint is below lo and the walk
+ * stops once starts pass hi, so the cost is output-sensitive: O(log n + k)
+ * for typical data and never worse than O(k log n).
+ */
+template<class Point, class Value>
+void IntervalTree<Point, Value>::overlapping(const Point& lo, const Point& hi, std::vector<iterator>& out) const
+{
+    std::vector<IntervalNode<Point, Value>*> stack;
+    IntervalNode<Point, Value>* current = asInterval(this->root_);
+
+    while (current != NULL || !stack.empty()) {
+        // descend left while the subtree can still reach lo
+        while (current != NULL && !(current->getMaxEnd() < lo)) {
+            stack.push_back(current);
+            current = asInterval(current->getLeft());
+        }
+        if (stack.empty()) {
+            break;
+        }
+        current = stack.back();
+        stack.pop_back();
+
+        const Interval& key = current->getKey();
+        if (hi < key.first) {
+            // this and every later start is past the query
+            break;
+        }
+        if (!(key.second < lo)) {
+            out.push_back(this->iteratorFor(current));
+        }
+        current = asInterval(current->getRight());
+    }
+}
+
+/**
+ * Returns an interval containing point, or end() if none does.
+ * Follows a single root-to-leaf path: if the left subtree reaches the
+ * point then either it holds a match or the right subtree cannot.
+ */
+template<class Point, class Value>
+typename IntervalTree<Point, Value>::iterator IntervalTree<Point, Value>::stab(const Point& point) const
+{
+    IntervalNode<Point, Value>* current = asInterval(this->root_);
+    while (current != NULL) {
+        const Interval& key = current->getKey();
+        if (!(point < key.first) && !(key.second < point)) {
+            return this->iteratorFor(current);
+        }
+        IntervalNode<Point, Value>* left = asInterval(current->getLeft());
+        if (left != NULL && !(left->getMaxEnd() < point)) {
+            current = left;
+        } else {
+            current = asInterval(current->getRight());
+        }
+    }
+    return this->end();
+}
+
+template<class Point, class Value>
+AVLNode<std::pair<Point, Point>, Value>* IntervalTree<Point, Value>::makeNode(
+    const Interval& key, const Value& value, AVLNode<Interval, Value>* parent)
+{
+    return new IntervalNode<Point, Value>(key, value, parent);
+}
+
+template<class Point, class Value>
+AVLNode<std::pair<Point, Point>, Value>* IntervalTree<Point, Value>::relocateNode(AVLNode<Interval, Value>* node, void* where)
+{
+    return new (where) IntervalNode<Point, Value>(*asInterval(node));
+}
+
+template<class Point, class Value>
+size_t IntervalTree<Point, Value>::nodeBytes() const
+{
+    return sizeof(IntervalNode<Point, Value>);
+}
+
+template<class Point, class Value>
+const std::type_info& IntervalTree<Point, Value>::nodeType() const
+{
+    return typeid(IntervalNode<Point, Value>);
+}
+
+/**
+ * Recomputes a node's max-endpoint from its own interval and children.
+ */
+template<class Point, class Value>
+void IntervalTree<Point, Value>::updateAugment(AVLNode<Interval, Value>* node)
+{
+    IntervalNode<Point, Value>* n = asInterval(node);
+    Point maxEnd = n->getKey().second;
+    if (n->getLeft() != NULL) {
+        maxEnd = std::max(maxEnd, asInterval(n->getLeft())->getMaxEnd());
+    }
+    if (n->getRight() != NULL) {
+        maxEnd = std::max(maxEnd, asInterval(n->getRight())->getMaxEnd());
+    }
+    n->setMaxEnd(maxEnd);
+}
+
+template<class Point, class Value>
+void IntervalTree<Point, Value>::updateAugmentPath(AVLNode<Interval, Value>* node)
+{
+    while (node != NULL) {
+        updateAugment(node);
+        node = node->getParent();
+    }
+}
+
+/**
+ * Besides the AVL checks, the stored max-endpoint must match the
+ * subtree's real maximum.
+ */
+template<class Point, class Value>
+bool IntervalTree<Point, Value>::validateNode(Node<Interval, Value>* node, int leftHeight, int rightHeight) const
+{
+    if (!AVLTree<Interval, Value, VirtualAugment>::validateNode(node, leftHeight, rightHeight)) {
+        return false;
+    }
+    IntervalNode<Point, Value>* n = asInterval(node);
+    Point maxEnd = n->getKey().second;
+    if (n->getLeft() != NULL) {
+        maxEnd = std::max(maxEnd, asInterval(n->getLeft())->getMaxEnd());
+    }
+    if (n->getRight() != NULL) {
+        maxEnd = std::max(maxEnd, asInterval(n->getRight())->getMaxEnd());
+    }
+    return !(maxEnd < n->getMaxEnd()) && !(n->getMaxEnd() < maxEnd);
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(LATENCY_USE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define LATENCY_HAVE_RDTSC 1
+#endif
+
+/**
+ * A log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values below 64 are counted exactly; larger values are split into
+ * 32 sub-buckets per power of two, so every recorded value is resolved
+ * to within ~3%. Recording is O(1) and the histogram is a fixed 15KB
+ * regardless of how many samples it holds, so it can sit on the hot
+ * path of a benchmark for billions of operations.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void clear();
+
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+    uint64_t percentile(double p) const;
+
+    void writeJson(std::ostream& os) const;
+
+private:
+    static const int SUB_BITS = 6;
+    static const int HALF = 1 << (SUB_BITS - 1);
+    static const int NUM_BUCKETS = (64 - SUB_BITS + 1) * HALF + HALF;
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketHighest(int index);
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t min_;
+    uint64_t max_;
+    double sum_;
+};
+
+inline LatencyHistogram::LatencyHistogram() :
+    counts_(NUM_BUCKETS, 0)
+{
+    clear();
+}
+
+inline void LatencyHistogram::clear()
+{
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+}
+
+inline int LatencyHistogram::bucketIndex(uint64_t value)
+{
+    if (value < (uint64_t)(2 * HALF)) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS + 1;
+    return shift * HALF + (int)(value >> shift);
+}
+
+/**
+ * Returns the largest value that falls into the given bucket.
+ */
+inline uint64_t LatencyHistogram::bucketHighest(int index)
+{
+    if (index < 2 * HALF) {
+        return (uint64_t)index;
+    }
+    int shift = index / HALF - 1;
+    uint64_t mantissa = (uint64_t)(index % HALF + HALF);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t value)
+{
+    counts_[bucketIndex(value)]++;
+    total_++;
+    sum_ += (double)value;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+}
+
+inline uint64_t LatencyHistogram::count() const
+{
+    return total_;
+}
+
+inline uint64_t LatencyHistogram::min() const
+{
+    return total_ == 0 ? 0 : min_;
+}
+
+inline uint64_t LatencyHistogram::max() const
+{
+    return max_;
+}
+
+inline double LatencyHistogram::mean() const
+{
+    return total_ == 0 ? 0.0 : sum_ / (double)total_;
+}
+
+/**
+ * Returns the value at percentile p (0..100), reported as the highest
+ * value of the bucket that contains it and clamped to the true max.
+ */
+inline uint64_t LatencyHistogram::percentile(double p) const
+{
+    if (total_ == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)total_ + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total_) rank = total_;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucketHighest(i), max_);
+        }
+    }
+    return max_;
+}
+
+inline void LatencyHistogram::writeJson(std::ostream& os) const
+{
+    os << "{\"count\": " << count()
+       << ", \"min\": " << min()
+       << ", \"mean\": " << mean()
+       << ", \"p50\": " << percentile(50)
+       << ", \"p90\": " << percentile(90)
+       << ", \"p99\": " << percentile(99)
+       << ", \"p999\": " << percentile(99.9)
+       << ", \"max\": " << max() << "}";
+}
+
+/**
+ * Timestamp source for latency sampling. Uses rdtsc when built with
+ * -DLATENCY_USE_RDTSC on x86 (cheaper and finer than a clock read) and
+ * std::chrono::steady_clock otherwise. toNanos() converts a difference
+ * of two now() readings into nanoseconds.
+ */
+class LatencyClock
+{
+public:
+    LatencyClock();
+
+    uint64_t now() const;
+    uint64_t toNanos(uint64_t ticks) const;
+    const char* source() const;
+
+private:
+    double nanosPerTick_;
+};
+
+inline uint64_t LatencyClock::now() const
+{
+#ifdef LATENCY_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline LatencyClock::LatencyClock() : nanosPerTick_(1.0)
+{
+#ifdef LATENCY_HAVE_RDTSC
+    // calibrate the TSC against steady_clock over ~20ms
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startTicks = __rdtsc();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) { }
+    uint64_t ticks = __rdtsc() - startTicks;
+    double nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    nanosPerTick_ = ticks == 0 ? 1.0 : nanos / (double)ticks;
+#endif
+}
+
+inline uint64_t LatencyClock::toNanos(uint64_t ticks) const
+{
+    return (uint64_t)((double)ticks * nanosPerTick_);
+}
+
+inline const char* LatencyClock::source() const
+{
+#ifdef LATENCY_HAVE_RDTSC
+    return "rdtsc";
+#else
+    return "steady_clock";
+#endif
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef MEMUSAGE_H
+#define MEMUSAGE_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Page size assumed when measuring how densely nodes are packed.
+#define MEMUSAGE_PAGE_BYTES 4096
+// Independently locked parts of the MemoryRegistry list.
+#define MEMUSAGE_REGISTRY_STRIPES 16
+
+/**
+ * Footprint of a tree as reported by memory_usage(). The per-field
+ * byte counts split nodes * nodeBytes; allocatedBytes is what the
+ * allocator actually handed out for those nodes.
+ */
+struct MemoryUsage
+{
+    size_t nodes;
+    size_t nodeBytes;       // size of one node
+    size_t payloadBytes;    // the key/value pairs (their inline part only)
+    size_t pointerBytes;    // parent, left and right links
+    size_t vptrBytes;
+    size_t balanceBytes;    // balance factors, 0 for a plain BST
+    size_t paddingBytes;    // alignment padding and subclass fields
+    size_t allocatedBytes;  // node storage including allocator headers and unused slots
+    size_t slackBytes;      // allocatedBytes not holding a live node
+    size_t auxiliaryBytes;  // everything else the tree owns (filters, buffers)
+    size_t pagesSpanned;    // distinct pages holding nodes, if counted
+
+    MemoryUsage() :
+        nodes(0), nodeBytes(0), payloadBytes(0), pointerBytes(0), vptrBytes(0), balanceBytes(0),
+        paddingBytes(0), allocatedBytes(0), slackBytes(0), auxiliaryBytes(0), pagesSpanned(0)
+    {
+
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other);
+    size_t totalBytes() const;
+    double overheadRatio() const;
+    double fragmentation() const;
+};
+
+inline MemoryUsage& MemoryUsage::operator+=(const MemoryUsage& other)
+{
+    nodes += other.nodes;
+    // nodeBytes is per node; keep it only while every tree agrees
+    nodeBytes = (nodeBytes == 0 || nodeBytes == other.nodeBytes) ? other.nodeBytes : 0;
+    payloadBytes += other.payloadBytes;
+    pointerBytes += other.pointerBytes;
+    vptrBytes += other.vptrBytes;
+    balanceBytes += other.balanceBytes;
+    paddingBytes += other.paddingBytes;
+    allocatedBytes += other.allocatedBytes;
+    slackBytes += other.slackBytes;
+    auxiliaryBytes += other.auxiliaryBytes;
+    pagesSpanned += other.pagesSpanned;
+    return *this;
+}
+
+inline size_t MemoryUsage::totalBytes() const
+{
+    return allocatedBytes + auxiliaryBytes;
+}
+
+/**
+ * Bytes held per byte of payload; 1.0 would mean no overhead at all.
+ */
+inline double MemoryUsage::overheadRatio() const
+{
+    return payloadBytes == 0 ? 0.0 : double(totalBytes()) / payloadBytes;
+}
+
+/**
+ * Share of the pages touched by nodes that does not hold node bytes:
+ * 0 for nodes packed back to back, near 1 for nodes strewn one per page.
+ * Only meaningful when pages were counted.
+ */
+inline double MemoryUsage::fragmentation() const
+{
+    if (pagesSpanned == 0) {
+        return 0.0;
+    }
+    double used = double(nodes) * nodeBytes / (double(pagesSpanned) * MEMUSAGE_PAGE_BYTES);
+    return used >= 1.0 ? 0.0 : 1.0 - used;
+}
+
+/**
+ * Process-wide heap numbers from the allocator (glibc only; zero
+ * elsewhere).
+ */
+struct AllocatorStats
+{
+    size_t heapBytes;   // obtained from the OS, mmapped blocks included
+    size_t inUseBytes;  // handed out to the program
+    size_t freeBytes;   // held by the allocator but not in use
+
+    AllocatorStats() : heapBytes(0), inUseBytes(0), freeBytes(0) {}
+
+    static AllocatorStats current();
+
+    /**
+     * Share of the heap the allocator holds but cannot give back to us.
+     */
+    double fragmentation() const
+    {
+        return heapBytes == 0 ? 0.0 : double(freeBytes) / heapBytes;
+    }
+};
+
+inline AllocatorStats AllocatorStats::current()
+{
+    AllocatorStats stats;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    stats.heapBytes = info.arena + info.hblkhd;
+    stats.inUseBytes = info.uordblks + info.hblkhd;
+    stats.freeBytes = info.fordblks;
+#endif
+    return stats;
+}
+
+/**
+ * Process-wide list of live trees and their node counts and bytes, so
+ * that capacity planning and OOM alerts see every tree without the
+ * owners having to collect them. Every AVLTree registers itself;
+ * anything else can hold an Entry and keep it up to date.
+ *
+ * Each Entry keeps its own counters, written only by its tree as nodes
+ * come and go, so total() costs one read per tree rather than a walk of
+ * every node, and may run on any thread while the trees are changing.
+ * The list is split into MEMUSAGE_REGISTRY_STRIPES parts with a lock
+ * each, so trees built on different threads rarely wait for each other.
+ */
+class MemoryRegistry
+{
+public:
+    /**
+     * Registers its counters for as long as it lives. Only one thread
+     * at a time may update them (the one changing the tree); any thread
+     * may read them.
+     */
+    class Entry
+    {
+    public:
+        Entry();
+        Entry(const Entry& other);
+        Entry& operator=(const Entry& other);
+        ~Entry();
+
+        void update(size_t nodes, size_t bytes);
+        size_t nodes() const;
+        size_t bytes() const;
+
+    protected:
+        friend class MemoryRegistry;
+        void link();
+        size_t stripe() const;
+
+        std::atomic<size_t> nodes_;
+        std::atomic<size_t> bytes_;
+        Entry* prev_;
+        Entry* next_;
+    };
+
+    static MemoryUsage total();
+    static size_t liveTrees();
+
+protected:
+    static std::mutex& lock(size_t stripe);
+    static Entry*& head(size_t stripe);
+};
+
+inline std::mutex& MemoryRegistry::lock(size_t stripe)
+{
+    static std::mutex registryLocks[MEMUSAGE_REGISTRY_STRIPES];
+    return registryLocks[stripe];
+}
+
+inline MemoryRegistry::Entry*& MemoryRegistry::head(size_t stripe)
+{
+    static Entry* first[MEMUSAGE_REGISTRY_STRIPES] = {};
+    return first[stripe];
+}
+
+inline MemoryRegistry::Entry::Entry() : nodes_(0), bytes_(0), prev_(NULL)
+{
+    link();
+}
+
+/**
+ * A copy is a separate registration that starts from the same counts.
+ */
+inline MemoryRegistry::Entry::Entry(const Entry& other) :
+    nodes_(other.nodes()), bytes_(other.bytes()), prev_(NULL)
+{
+    link();
+}
+
+inline MemoryRegistry::Entry& MemoryRegistry::Entry::operator=(const Entry& other)
+{
+    update(other.nodes(), other.bytes());
+    return *this;
+}
+
+inline MemoryRegistry::Entry::~Entry()
+{
+    size_t s = stripe();
+    std::lock_guard<std::mutex> guard(MemoryRegistry::lock(s));
+    if (prev_ != NULL) {
+        prev_->next_ = next_;
+    }
+    else {
+        MemoryRegistry::head(s) = next_;
+    }
+    if (next_ != NULL) {
+        next_->prev_ = prev_;
+    }
+}
+
+inline size_t MemoryRegistry::Entry::stripe() const
+{
+    return (reinterpret_cast<uintptr_t>(this) >> 6) % MEMUSAGE_REGISTRY_STRIPES;
+}
+
+inline void MemoryRegistry::Entry::link()
+{
+    size_t s = stripe();
+    std::lock_guard<std::mutex> guard(MemoryRegistry::lock(s));
+    Entry*& first = MemoryRegistry::head(s);
+    next_ = first;
+    if (first != NULL) {
+        first->prev_ = this;
+    }
+    first = this;
+}
+
+/**
+ * Publishes the owner's current counts. Relaxed stores: a reader may see
+ * the two from slightly different moments, never a torn value.
+ */
+inline void MemoryRegistry::Entry::update(size_t nodes, size_t bytes)
+{
+    nodes_.store(nodes, std::memory_order_relaxed);
+    bytes_.store(bytes, std::memory_order_relaxed);
+}
+
+inline size_t MemoryRegistry::Entry::nodes() const
+{
+    return nodes_.load(std::memory_order_relaxed);
+}
+
+inline size_t MemoryRegistry::Entry::bytes() const
+{
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Sums the registered counters into nodes and allocatedBytes; the rest
+ * of the breakdown needs a walk, so ask a tree's memory_usage() for it.
+ */
+inline MemoryUsage MemoryRegistry::total()
+{
+    MemoryUsage sum;
+    for (size_t s = 0; s < MEMUSAGE_REGISTRY_STRIPES; ++s) {
+        std::lock_guard<std::mutex> guard(lock(s));
+        for (Entry* e = head(s); e != NULL; e = e->next_) {
+            sum.nodes += e->nodes();
+            sum.allocatedBytes += e->bytes();
+        }
+    }
+    return sum;
+}
+
+inline size_t MemoryRegistry::liveTrees()
+{
+    size_t count = 0;
+    for (size_t s = 0; s < MEMUSAGE_REGISTRY_STRIPES; ++s) {
+        std::lock_guard<std::mutex> guard(lock(s));
+        for (Entry* e = head(s); e != NULL; e = e->next_) {
+            count++;
+        }
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+#include "avlbst.h"
+
+/**
+ * A fixed-size chunk allocator: chunks are carved from slabs that double
+ * in size and recycled through an intrusive free list. Not thread-safe;
+ * each owner (one tree, one shard) keeps its own pool behind its own lock.
+ */
+class NodePool
+{
+public:
+    explicit NodePool(size_t chunkBytes);
+    ~NodePool();
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    void* allocate();
+    void release(void* chunk);
+    size_t chunkBytes() const;
+    size_t reservedBytes() const;
+
+protected:
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+
+    static const size_t FIRST_SLAB_CHUNKS = 64;
+    static const size_t MAX_SLAB_CHUNKS = 65536;
+
+    std::vector<char*> slabs_;
+    FreeChunk* free_;
+    char* bump_;        // unused tail of the newest slab
+    char* bumpEnd_;
+    size_t chunk_;
+    size_t slabChunks_;
+    size_t reserved_;
+};
+
+inline NodePool::NodePool(size_t chunkBytes) :
+    free_(NULL), bump_(NULL), bumpEnd_(NULL), slabChunks_(FIRST_SLAB_CHUNKS), reserved_(0)
+{
+    // keep every chunk aligned for any node type
+    const size_t align = alignof(std::max_align_t);
+    chunk_ = std::max(chunkBytes, sizeof(FreeChunk));
+    chunk_ = (chunk_ + align - 1) / align * align;
+}
+
+inline NodePool::~NodePool()
+{
+    for (size_t i = 0; i < slabs_.size(); ++i) {
+        ::operator delete(slabs_[i]);
+    }
+}
+
+inline void* NodePool::allocate()
+{
+    if (free_ != NULL) {
+        FreeChunk* chunk = free_;
+        free_ = chunk->next;
+        return chunk;
+    }
+    if (bump_ == bumpEnd_) {
+        size_t bytes = slabChunks_ * chunk_;
+        bump_ = static_cast<char*>(::operator new(bytes));
+        bumpEnd_ = bump_ + bytes;
+        slabs_.push_back(bump_);
+        reserved_ += bytes;
+        if (slabChunks_ < MAX_SLAB_CHUNKS) {
+            slabChunks_ *= 2;
+        }
+    }
+    void* chunk = bump_;
+    bump_ += chunk_;
+    return chunk;
+}
+
+inline void NodePool::release(void* chunk)
+{
+    FreeChunk* freed = static_cast<FreeChunk*>(chunk);
+    freed->next = free_;
+    free_ = freed;
+}
+
+inline size_t NodePool::chunkBytes() const
+{
+    return chunk_;
+}
+
+/**
+ * Bytes held in slabs, whether in use or on the free list.
+ */
+inline size_t NodePool::reservedBytes() const
+{
+    return reserved_;
+}
+
+/**
+ * An AVLTree whose nodes come from its own NodePool instead of the
+ * global heap, so that trees used from different threads never contend
+ * in the allocator and a tree's nodes stay packed together.
+ *
+ * Nodes handed out by extract() are moved to the heap first, and nodes
+ * passed to insert(node_type&&) are copied into the pool rather than
+ * adopted.
+ */
+template <typename Key, typename Value>
+class PooledAVLTree : public AVLTree<Key, Value>
+{
+public:
+    PooledAVLTree();
+    virtual ~PooledAVLTree();
+
+    const NodePool& pool() const;
+
+protected:
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) override;
+    virtual void destroyNode(Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* releaseNode(Node<Key, Value>* node) override;
+    virtual bool canAdopt(Node<Key, Value>* node) const override;
+    virtual size_t heapNodeBytes(Node<Key, Value>* node) const override;
+    virtual size_t storageBytes() const override;
+
+    NodePool pool_;
+};
+
+template<class Key, class Value>
+PooledAVLTree<Key, Value>::PooledAVLTree() : pool_(sizeof(AVLNode<Key, Value>))
+{
+
+}
+
+/**
+ * Clears before pool_ is destroyed, so every node goes back to it.
+ */
+template<class Key, class Value>
+PooledAVLTree<Key, Value>::~PooledAVLTree()
+{
+    this->clear();
+}
+
+template<class Key, class Value>
+const NodePool& PooledAVLTree<Key, Value>::pool() const
+{
+    return pool_;
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* PooledAVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new (pool_.allocate()) AVLNode<Key, Value>(key, value, parent);
+}
+
+/**
+ * compact() nodes go back through AVLTree; the rest return to the pool.
+ */
+template<class Key, class Value>
+void PooledAVLTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
+    if (this->inArena(node)) {
+        AVLTree<Key, Value>::destroyNode(node);
+        return;
+    }
+    node->~Node();
+    pool_.release(node);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* PooledAVLTree<Key, Value>::releaseNode(Node<Key, Value>* node)
+{
+    if (this->inArena(node)) {
+        return AVLTree<Key, Value>::releaseNode(node);
+    }
+    Node<Key, Value>* moved = this->relocateNode(static_cast<AVLNode<Key, Value>*>(node), ::operator new(this->nodeBytes()));
+    node->~Node();
+    pool_.release(node);
+    return moved;
+}
+
+/**
+ * Released nodes live on the heap and destroyNode() would hand them to
+ * the pool, so insert(node_type&&) always copies them in.
+ */
+template<class Key, class Value>
+bool PooledAVLTree<Key, Value>::canAdopt(Node<Key, Value>*) const
+{
+    return false;
+}
+
+/**
+ * Pool chunks are not malloc blocks, and the pool keeps them when the
+ * node goes; storageBytes() counts the pool as a whole instead.
+ */
+template<class Key, class Value>
+size_t PooledAVLTree<Key, Value>::heapNodeBytes(Node<Key, Value>*) const
+{
+    return 0;
+}
+
+template<class Key, class Value>
+size_t PooledAVLTree<Key, Value>::storageBytes() const
+{
+    return AVLTree<Key, Value>::storageBytes() + pool_.reservedBytes();
+}
+
+#endif
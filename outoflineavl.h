@@ -0,0 +1,294 @@
+#ifndef OUTOFLINEAVL_H
+#define OUTOFLINEAVL_H
+
+#include <iostream>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+#include <new>
+#include "avlbst.h"
+#include "nodepool.h"
+
+// Values larger than this go out of line in ValueSizedAVLTree.
+#define VALUE_INLINE_BYTES 64
+
+/**
+ * Where an OutOfLineAVLTree node keeps its value: a pointer into the
+ * tree's value pool. Converts to Value&, so `Value& v = it->second;`
+ * reads the same for an AVLTree and an OutOfLineAVLTree. Like a
+ * reference, assigning to it assigns the value; it cannot be reseated.
+ */
+template <typename Value>
+class ValueRef
+{
+public:
+    ValueRef();
+    explicit ValueRef(Value* value);
+    ValueRef(const ValueRef& other) = default;
+    ValueRef& operator=(const ValueRef& other);
+    ValueRef& operator=(const Value& value);
+
+    Value& get() const;
+    Value& operator*() const;
+    Value* operator->() const;
+    operator Value&() const;
+
+protected:
+    Value* value_;
+};
+
+template<class Value>
+ValueRef<Value>::ValueRef() : value_(NULL)
+{
+
+}
+
+template<class Value>
+ValueRef<Value>::ValueRef(Value* value) : value_(value)
+{
+
+}
+
+template<class Value>
+ValueRef<Value>& ValueRef<Value>::operator=(const ValueRef& other)
+{
+    *value_ = *other.value_;
+    return *this;
+}
+
+template<class Value>
+ValueRef<Value>& ValueRef<Value>::operator=(const Value& value)
+{
+    *value_ = value;
+    return *this;
+}
+
+template<class Value>
+Value& ValueRef<Value>::get() const
+{
+    return *value_;
+}
+
+template<class Value>
+Value& ValueRef<Value>::operator*() const
+{
+    return *value_;
+}
+
+template<class Value>
+Value* ValueRef<Value>::operator->() const
+{
+    return value_;
+}
+
+template<class Value>
+ValueRef<Value>::operator Value&() const
+{
+    return *value_;
+}
+
+template<class Value>
+std::ostream& operator<<(std::ostream& os, const ValueRef<Value>& ref)
+{
+    return os << ref.get();
+}
+
+/**
+ * An AVLTree that keeps each value in a NodePool of its own and only a
+ * pointer to it in the node. With large values an AVLNode spans several
+ * cache lines and its links sit after the value; here key, links and
+ * balance share one line, so a descent reads nothing else until the
+ * caller follows it->second.
+ *
+ * insert() and operator[] take and return plain Values. Nodes are
+ * iterated as pairs of key and ValueRef<Value>. The AVLTree base is
+ * private and only the calls that cannot plant a ValueRef from outside
+ * are forwarded, so every node's value comes from this tree's pool.
+ */
+template <typename Key, typename Value>
+class OutOfLineAVLTree : private AVLTree<Key, ValueRef<Value> >
+{
+public:
+    static_assert(alignof(Value) <= alignof(std::max_align_t),
+                  "OutOfLineAVLTree cannot over-align values");
+
+    typedef AVLTree<Key, ValueRef<Value> > Base;
+    typedef typename Base::iterator iterator;
+
+    OutOfLineAVLTree();
+    virtual ~OutOfLineAVLTree();
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    Value& operator[](const Key& key);
+    const Value& operator[](const Key& key) const;
+    const NodePool& valuePool() const;
+
+    using Base::remove;
+    using Base::erase;
+    using Base::clear;
+    using Base::compact;
+    using Base::begin;
+    using Base::end;
+    using Base::find;
+    using Base::find_many;
+    using Base::lower_bound;
+    using Base::upper_bound;
+    using Base::empty;
+    using Base::size;
+    using Base::isBalanced;
+    using Base::validate;
+    using Base::print;
+    using Base::memory_usage;
+    using Base::setRecorder;
+    using Base::recorder;
+
+protected:
+    ValueRef<Value> makeValue(const Value& value);
+    void freeValue(const ValueRef<Value>& ref);
+    Node<Key, ValueRef<Value> >* attachValue(Node<Key, ValueRef<Value> >* parent, bool left,
+                                             const Key& key, const Value& value);
+    virtual Node<Key, ValueRef<Value> >* unlinkNode(Node<Key, ValueRef<Value> >* node) override;
+    virtual void clearHelper(Node<Key, ValueRef<Value> >* node) override;
+    virtual size_t auxiliaryBytes() const override;
+
+    NodePool values_;
+};
+
+template<class Key, class Value>
+OutOfLineAVLTree<Key, Value>::OutOfLineAVLTree() : values_(sizeof(Value))
+{
+
+}
+
+/**
+ * Clears before values_ is destroyed, so every value is destructed.
+ */
+template<class Key, class Value>
+OutOfLineAVLTree<Key, Value>::~OutOfLineAVLTree()
+{
+    this->clear();
+}
+
+template<class Key, class Value>
+ValueRef<Value> OutOfLineAVLTree<Key, Value>::makeValue(const Value& value)
+{
+    void* slot = values_.allocate();
+    try {
+        return ValueRef<Value>(new (slot) Value(value));
+    }
+    catch (...) {
+        values_.release(slot);
+        throw;
+    }
+}
+
+template<class Key, class Value>
+void OutOfLineAVLTree<Key, Value>::freeValue(const ValueRef<Value>& ref)
+{
+    Value* value = &ref.get();
+    value->~Value();
+    values_.release(value);
+}
+
+template<class Key, class Value>
+Node<Key, ValueRef<Value> >* OutOfLineAVLTree<Key, Value>::attachValue(Node<Key, ValueRef<Value> >* parent, bool left,
+                                                                       const Key& key, const Value& value)
+{
+    ValueRef<Value> ref = makeValue(value);
+    try {
+        return this->attachNode(parent, left, key, ref);
+    }
+    catch (...) {
+        freeValue(ref);
+        throw;
+    }
+}
+
+/*
+ * Like AVLTree::insert(), but a present key has its value assigned in
+ * place and keeps its slot.
+ */
+template<class Key, class Value>
+std::pair<typename OutOfLineAVLTree<Key, Value>::iterator, bool>
+OutOfLineAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    this->traceOp(TRACE_INSERT, keyValuePair.first);
+    Node<Key, ValueRef<Value> >* parent;
+    bool left;
+    Node<Key, ValueRef<Value> >* existing = this->locate(keyValuePair.first, parent, left);
+    if (existing != NULL) {
+        existing->getValue() = keyValuePair.second;
+        return std::make_pair(this->iteratorFor(existing), false);
+    }
+    Node<Key, ValueRef<Value> >* node = attachValue(parent, left, keyValuePair.first, keyValuePair.second);
+    return std::make_pair(this->iteratorFor(node), true);
+}
+
+template<class Key, class Value>
+Value& OutOfLineAVLTree<Key, Value>::operator[](const Key& key)
+{
+    Node<Key, ValueRef<Value> >* parent;
+    bool left;
+    Node<Key, ValueRef<Value> >* node = this->locate(key, parent, left);
+    this->traceOp(node != NULL ? TRACE_FIND : TRACE_INSERT, key);
+    if (node == NULL) {
+        node = attachValue(parent, left, key, Value());
+    }
+    return node->getValue().get();
+}
+
+template<class Key, class Value>
+const Value& OutOfLineAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    return Base::operator[](key).get();
+}
+
+/**
+ * The pool holding the values, for its reservedBytes().
+ */
+template<class Key, class Value>
+const NodePool& OutOfLineAVLTree<Key, Value>::valuePool() const
+{
+    return values_;
+}
+
+/**
+ * Every node leaving the tree passes through here (destroyNode() also
+ * sees nodes that compact() is merely moving), so values die here.
+ */
+template<class Key, class Value>
+Node<Key, ValueRef<Value> >* OutOfLineAVLTree<Key, Value>::unlinkNode(Node<Key, ValueRef<Value> >* node)
+{
+    Node<Key, ValueRef<Value> >* unlinked = Base::unlinkNode(node);
+    freeValue(unlinked->getValue());
+    return unlinked;
+}
+
+template<class Key, class Value>
+void OutOfLineAVLTree<Key, Value>::clearHelper(Node<Key, ValueRef<Value> >* node)
+{
+    if (node != NULL) {
+        for (iterator it = this->iteratorFor(this->getSmallestNode()); it != this->end(); ++it) {
+            freeValue(it->second);
+        }
+    }
+    Base::clearHelper(node);
+}
+
+template<class Key, class Value>
+size_t OutOfLineAVLTree<Key, Value>::auxiliaryBytes() const
+{
+    return values_.reservedBytes();
+}
+
+/**
+ * AVLTree<Key, Value> for values of up to Threshold bytes and
+ * OutOfLineAVLTree<Key, Value> for larger ones, in the way AVLMap picks
+ * CompactAVLTree. Bind `Value& v = it->second;` to use either.
+ */
+template <typename Key, typename Value, size_t Threshold = VALUE_INLINE_BYTES>
+using ValueSizedAVLTree = typename std::conditional<(sizeof(Value) > Threshold),
+                                                    OutOfLineAVLTree<Key, Value>,
+                                                    AVLTree<Key, Value> >::type;
+
+#endif
@@ -0,0 +1,78 @@
+// parallel_reduce() and parallel_for_each() against a serial iterator
+// scan of the same tree, by thread count.
+//
+//   make parallel-bench
+//   ./parallel-bench [entries] [max-threads]
+//
+// The reduction hashes each value before summing so that the scan does
+// some work per entry, as the nightly aggregation jobs do.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+#include "paralleltraversal.h"
+#include "hashmix.h"
+
+using namespace std;
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+typedef std::pair<const uint64_t, uint64_t> Item;
+
+static double seconds(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    unsigned maxThreads = argc > 2 ? atoi(argv[2]) : 8;
+
+    Tree tree;
+    for (uint64_t k = 0; k < entries; ++k) {
+        tree.insert(make_pair(mixHash(k), k));
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    uint64_t expected = 0;
+    for (Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        expected += mixHash(it->second);
+    }
+    double serialSec = seconds(start);
+
+    cout << entries << " entries, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << "serial iterator reduce: " << fixed << setprecision(1) << serialSec * 1e3 << " ms" << endl;
+    cout << setw(8) << "threads" << setw(14) << "reduce ms" << setw(10) << "speedup" << setw(16) << "for_each ms" << endl;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        start = chrono::steady_clock::now();
+        uint64_t sum = parallel_reduce(tree, uint64_t(0),
+                                       [](const Item& item) { return mixHash(item.second); },
+                                       [](uint64_t a, uint64_t b) { return a + b; },
+                                       threads);
+        double reduceSec = seconds(start);
+        if (sum != expected) {
+            cerr << "parallel-bench: parallel_reduce disagrees with the serial scan" << endl;
+            return 1;
+        }
+
+        start = chrono::steady_clock::now();
+        parallel_for_each(tree, [](Item& item) { item.second = mixHash(item.second); }, threads);
+        double forEachSec = seconds(start);
+
+        cout << setw(8) << threads << setw(14) << reduceSec * 1e3
+             << setw(10) << setprecision(2) << serialSec / reduceSec
+             << setw(16) << setprecision(1) << forEachSec * 1e3 << endl;
+
+        // for_each rehashed every value; recompute the serial answer
+        expected = 0;
+        for (Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            expected += mixHash(it->second);
+        }
+    }
+    return 0;
+}
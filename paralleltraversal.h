@@ -0,0 +1,386 @@
+#ifndef PARALLELTRAVERSAL_H
+#define PARALLELTRAVERSAL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <exception>
+#include "bst.h"
+
+// Subtrees expected to hold fewer entries than this are walked serially.
+#define PARALLEL_GRAIN 4096
+
+/**
+ * A fork/join pool that lives for one parallel traversal. Each worker,
+ * the calling thread included, pushes and pops its forked tasks at the
+ * back of its own deque; a worker with nothing to do steals from the
+ * front of another's. join() runs other tasks while it waits.
+ */
+class WorkStealingPool
+{
+public:
+    struct Task {
+        std::function<void()> run;
+        std::atomic<bool> done;
+        std::exception_ptr error;
+
+        Task() : done(false) {}
+    };
+
+    explicit WorkStealingPool(unsigned threads);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void fork(Task* task);
+    void join(Task* task);
+
+protected:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    static unsigned& currentWorker();
+    void workerLoop(unsigned self);
+    bool runOne(unsigned self);
+    Task* pop(unsigned self);
+    Task* steal(unsigned self);
+    static void execute(Task* task);
+
+    std::vector<std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stop_;
+    unsigned callerWorker_;
+};
+
+inline WorkStealingPool::WorkStealingPool(unsigned threads) : stop_(false), callerWorker_(currentWorker())
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue));
+    }
+    // queue 0 belongs to the calling thread
+    currentWorker() = 0;
+    for (unsigned i = 1; i < threads; ++i) {
+        workers_.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+    }
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+    stop_.store(true);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i].join();
+    }
+    // the caller may itself be a worker of an enclosing pool
+    currentWorker() = callerWorker_;
+}
+
+/**
+ * Index of the calling thread's queue in the pool it is working for.
+ */
+inline unsigned& WorkStealingPool::currentWorker()
+{
+    static thread_local unsigned index = 0;
+    return index;
+}
+
+inline void WorkStealingPool::workerLoop(unsigned self)
+{
+    currentWorker() = self;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        if (!runOne(self)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void WorkStealingPool::fork(Task* task)
+{
+    Queue& queue = *queues_[currentWorker()];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(task);
+}
+
+/**
+ * Returns once task has run, on this thread or a thief. Rethrows
+ * anything the task threw.
+ */
+inline void WorkStealingPool::join(Task* task)
+{
+    unsigned self = currentWorker();
+    while (!task->done.load(std::memory_order_acquire)) {
+        if (!runOne(self)) {
+            std::this_thread::yield();
+        }
+    }
+    if (task->error) {
+        std::rethrow_exception(task->error);
+    }
+}
+
+inline bool WorkStealingPool::runOne(unsigned self)
+{
+    Task* task = pop(self);
+    if (task == NULL) {
+        task = steal(self);
+    }
+    if (task == NULL) {
+        return false;
+    }
+    execute(task);
+    return true;
+}
+
+inline WorkStealingPool::Task* WorkStealingPool::pop(unsigned self)
+{
+    Queue& queue = *queues_[self];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) {
+        return NULL;
+    }
+    Task* task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return task;
+}
+
+/**
+ * Takes the oldest task, i.e. the biggest subtree, from the first other
+ * queue that has one.
+ */
+inline WorkStealingPool::Task* WorkStealingPool::steal(unsigned self)
+{
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& queue = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            Task* task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return task;
+        }
+    }
+    return NULL;
+}
+
+inline void WorkStealingPool::execute(Task* task)
+{
+    try {
+        task->run();
+    }
+    catch (...) {
+        task->error = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+}
+
+/**
+ * Splits a tree at subtree roots for parallel_for_each() and
+ * parallel_reduce(). Nodes above forkDepth fork their right subtree as a
+ * task, recurse into the left and visit themselves; deeper subtrees are
+ * walked serially. forkDepth comes from the tree's size and the grain,
+ * which assumes a roughly balanced tree: a degenerate BST still gives
+ * correct results but little parallelism, so rebalance() it first.
+ */
+template <typename Key, typename Value>
+class ParallelTraversal
+{
+public:
+    ParallelTraversal(const BinarySearchTree<Key, Value>& tree, unsigned threads, size_t grain);
+
+    template <typename Fn>
+    void forEach(Fn& fn);
+    template <typename T, typename Fn, typename Combine>
+    T reduce(T init, Fn& fn, Combine& combine);
+
+protected:
+    template <typename Fn>
+    void forEachSubtree(Node<Key, Value>* node, unsigned depth, Fn& fn);
+    template <typename T, typename Fn, typename Combine>
+    T reduceSubtree(Node<Key, Value>* node, unsigned depth, Fn& fn, Combine& combine);
+    static Node<Key, Value>* leftmost(Node<Key, Value>* node);
+    static Node<Key, Value>* nextInSubtree(Node<Key, Value>* node, Node<Key, Value>* root);
+
+    Node<Key, Value>* root_;
+    unsigned forkDepth_;
+    std::unique_ptr<WorkStealingPool> pool_;
+};
+
+template<class Key, class Value>
+ParallelTraversal<Key, Value>::ParallelTraversal(const BinarySearchTree<Key, Value>& tree, unsigned threads, size_t grain) :
+    root_(tree.root_), forkDepth_(0)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads > 1) {
+        for (size_t n = tree.size(); n > std::max<size_t>(grain, 1); n /= 2) {
+            forkDepth_++;
+        }
+    }
+    if (forkDepth_ > 0) {
+        pool_.reset(new WorkStealingPool(threads));
+    }
+}
+
+template<class Key, class Value>
+Node<Key, Value>* ParallelTraversal<Key, Value>::leftmost(Node<Key, Value>* node)
+{
+    while (node->getLeft() != NULL) {
+        node = node->getLeft();
+    }
+    return node;
+}
+
+/**
+ * In-order successor of node that stays inside root's subtree, or NULL.
+ */
+template<class Key, class Value>
+Node<Key, Value>* ParallelTraversal<Key, Value>::nextInSubtree(Node<Key, Value>* node, Node<Key, Value>* root)
+{
+    if (node->getRight() != NULL) {
+        return leftmost(node->getRight());
+    }
+    while (node != root && node == node->getParent()->getRight()) {
+        node = node->getParent();
+    }
+    return node == root ? NULL : node->getParent();
+}
+
+template<class Key, class Value>
+template<typename Fn>
+void ParallelTraversal<Key, Value>::forEach(Fn& fn)
+{
+    if (root_ != NULL) {
+        forEachSubtree(root_, 0, fn);
+    }
+}
+
+template<class Key, class Value>
+template<typename Fn>
+void ParallelTraversal<Key, Value>::forEachSubtree(Node<Key, Value>* node, unsigned depth, Fn& fn)
+{
+    if (depth >= forkDepth_) {
+        for (Node<Key, Value>* n = leftmost(node); n != NULL; n = nextInSubtree(n, node)) {
+            fn(n->getItem());
+        }
+        return;
+    }
+
+    WorkStealingPool::Task right;
+    bool forked = node->getRight() != NULL;
+    if (forked) {
+        right.run = [this, node, depth, &fn]() { forEachSubtree(node->getRight(), depth + 1, fn); };
+        pool_->fork(&right);
+    }
+    try {
+        if (node->getLeft() != NULL) {
+            forEachSubtree(node->getLeft(), depth + 1, fn);
+        }
+        fn(node->getItem());
+    }
+    catch (...) {
+        // the task refers to this frame, so it must finish first
+        if (forked) {
+            try { pool_->join(&right); } catch (...) {}
+        }
+        throw;
+    }
+    if (forked) {
+        pool_->join(&right);
+    }
+}
+
+template<class Key, class Value>
+template<typename T, typename Fn, typename Combine>
+T ParallelTraversal<Key, Value>::reduce(T init, Fn& fn, Combine& combine)
+{
+    if (root_ == NULL) {
+        return init;
+    }
+    return combine(init, reduceSubtree<T>(root_, 0, fn, combine));
+}
+
+/**
+ * Folds a non-empty subtree in key order, so combine only needs to be
+ * associative.
+ */
+template<class Key, class Value>
+template<typename T, typename Fn, typename Combine>
+T ParallelTraversal<Key, Value>::reduceSubtree(Node<Key, Value>* node, unsigned depth, Fn& fn, Combine& combine)
+{
+    if (depth >= forkDepth_) {
+        Node<Key, Value>* n = leftmost(node);
+        T acc = fn(n->getItem());
+        while ((n = nextInSubtree(n, node)) != NULL) {
+            acc = combine(acc, fn(n->getItem()));
+        }
+        return acc;
+    }
+
+    WorkStealingPool::Task right;
+    std::unique_ptr<T> rightResult;
+    bool forked = node->getRight() != NULL;
+    if (forked) {
+        right.run = [this, node, depth, &fn, &combine, &rightResult]() {
+            rightResult.reset(new T(reduceSubtree<T>(node->getRight(), depth + 1, fn, combine)));
+        };
+        pool_->fork(&right);
+    }
+    std::unique_ptr<T> acc;
+    try {
+        if (node->getLeft() != NULL) {
+            acc.reset(new T(combine(reduceSubtree<T>(node->getLeft(), depth + 1, fn, combine), fn(node->getItem()))));
+        }
+        else {
+            acc.reset(new T(fn(node->getItem())));
+        }
+    }
+    catch (...) {
+        if (forked) {
+            try { pool_->join(&right); } catch (...) {}
+        }
+        throw;
+    }
+    if (forked) {
+        pool_->join(&right);
+        return combine(*acc, *rightResult);
+    }
+    return *acc;
+}
+
+/**
+ * Calls fn(std::pair<const Key, Value>&) once for every entry, from up to
+ * threads threads (0 means one per core). fn runs concurrently, in no
+ * particular order, and must be safe to call that way; it may change
+ * values but not the tree. The first exception fn throws is rethrown
+ * here once every task has stopped.
+ */
+template <typename Key, typename Value, typename Fn>
+void parallel_for_each(BinarySearchTree<Key, Value>& tree, Fn fn, unsigned threads = 0, size_t grain = PARALLEL_GRAIN)
+{
+    ParallelTraversal<Key, Value> traversal(tree, threads, grain);
+    traversal.forEach(fn);
+}
+
+/**
+ * Returns combine(init, fn(e1) + fn(e2) + ... + fn(en)) where + is
+ * combine and e1..en are the entries in key order. combine must be
+ * associative but need not be commutative; fn and combine run
+ * concurrently and must be safe to call that way.
+ */
+template <typename Key, typename Value, typename T, typename Fn, typename Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value>& tree, T init, Fn fn, Combine combine,
+                  unsigned threads = 0, size_t grain = PARALLEL_GRAIN)
+{
+    ParallelTraversal<Key, Value> traversal(tree, threads, grain);
+    return traversal.template reduce<T>(init, fn, combine);
+}
+
+#endif
@@ -0,0 +1,99 @@
+// PrefixStringTree vs. AVLTree<std::string> on path-like keys: heap
+// bytes per key, insert time and lookup time.
+//
+//   make prefix-bench
+//   ./prefix-bench [keys]
+//
+// Keys look like object store paths, 60-80 bytes with most of that
+// shared with their neighbours. Heap use is measured with AllocatorStats
+// around building each tree, so it includes std::string's own blocks.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "avlbst.h"
+#include "prefixavl.h"
+#include "memusage.h"
+#include "benchrand.h"
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static string makeKey(uint64_t i, uint64_t r)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "/var/lib/objectstore/volumes/tenant-%04u/project-%03u/objects/%012llx.chunk",
+             unsigned(r % 300), unsigned(r / 300 % 40), (unsigned long long)(i * 2654435761ull));
+    return buf;
+}
+
+template<typename Tree>
+static void run(const char* name, const vector<string>& keys, const vector<string>& probes, const vector<string>& misses)
+{
+    size_t heapBefore = AllocatorStats::current().inUseBytes;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Tree* tree = new Tree;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree->insert(make_pair(keys[i], uint64_t(i)));
+    }
+    double insertSec = secondsSince(start);
+    size_t heap = AllocatorStats::current().inUseBytes - heapBefore;
+
+    uint64_t sum = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        sum += tree->find(probes[i])->second;
+    }
+    double hitSec = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < misses.size(); ++i) {
+        sum += tree->find(misses[i]) == tree->end();
+    }
+    double missSec = secondsSince(start);
+
+    cout << setw(12) << name << fixed << setprecision(1) << setw(12) << double(heap) / keys.size()
+         << setw(12) << insertSec * 1e9 / keys.size() << setw(12) << hitSec * 1e9 / probes.size()
+         << setw(12) << missSec * 1e9 / misses.size() << "   [" << sum % 10 << "]" << endl;
+    delete tree;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t state = 88172645463325252ull;
+
+    vector<string> keys, probes, misses;
+    keys.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        keys.push_back(makeKey(i, nextRand(state)));
+    }
+    // duplicates are possible; probe only what was inserted
+    probes = keys;
+    for (size_t i = probes.size(); i > 1; --i) {
+        swap(probes[i - 1], probes[nextRand(state) % i]);
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        misses.push_back(makeKey(i + count, nextRand(state)));
+    }
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bytes += keys[i].size();
+    }
+    cout << count << " keys, " << fixed << setprecision(1) << double(bytes) / count << " bytes each" << endl;
+    cout << setw(12) << "tree" << setw(12) << "heap/key" << setw(12) << "insert ns" << setw(12) << "hit ns"
+         << setw(12) << "miss ns" << endl;
+    run<AVLTree<string, uint64_t> >("std::string", keys, probes, misses);
+    run<PrefixStringTree<uint64_t> >("prefix", keys, probes, misses);
+    return 0;
+}
@@ -0,0 +1,610 @@
+#ifndef PREFIXAVL_H
+#define PREFIXAVL_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "avlbst.h"
+
+// Keys sharing fewer leading bytes with their neighbour are stored whole.
+#define PREFIX_MIN_SHARED 8
+// Leading bytes of a key's own tail kept in the key itself.
+#define PREFIX_INLINE_BYTES 8
+// Bytes per arena block; longer keys get a block of their own.
+#define PREFIX_ARENA_BLOCK (64 << 10)
+
+/**
+ * Append-only byte storage in PREFIX_ARENA_BLOCK blocks, so stored bytes
+ * never move.
+ */
+class KeyArena
+{
+public:
+    KeyArena();
+    ~KeyArena();
+    KeyArena(const KeyArena&) = delete;
+    KeyArena& operator=(const KeyArena&) = delete;
+
+    const char* store(const char* data, size_t n);
+    void clear();
+    void swap(KeyArena& other);
+    size_t usedBytes() const;
+    size_t reservedBytes() const;
+
+protected:
+    std::vector<char*> blocks_;
+    char* next_;
+    size_t left_;
+    size_t used_;
+    size_t reserved_;
+};
+
+inline KeyArena::KeyArena() : next_(NULL), left_(0), used_(0), reserved_(0)
+{
+
+}
+
+inline KeyArena::~KeyArena()
+{
+    clear();
+}
+
+inline const char* KeyArena::store(const char* data, size_t n)
+{
+    if (n == 0) {
+        // nothing to copy, and a fresh arena has no block to point into
+        static const char none = 0;
+        return &none;
+    }
+    if (n > left_) {
+        size_t size = std::max<size_t>(n, PREFIX_ARENA_BLOCK);
+        char* block = new char[size];
+        blocks_.push_back(block);
+        reserved_ += size;
+        if (size > PREFIX_ARENA_BLOCK) {
+            // an oversized key gets its own block; keep filling the current one
+            used_ += n;
+            memcpy(block, data, n);
+            return block;
+        }
+        next_ = block;
+        left_ = size;
+    }
+    char* out = next_;
+    memcpy(out, data, n);
+    next_ += n;
+    left_ -= n;
+    used_ += n;
+    return out;
+}
+
+inline void KeyArena::clear()
+{
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        delete [] blocks_[i];
+    }
+    blocks_.clear();
+    next_ = NULL;
+    left_ = used_ = reserved_ = 0;
+}
+
+inline void KeyArena::swap(KeyArena& other)
+{
+    blocks_.swap(other.blocks_);
+    std::swap(next_, other.next_);
+    std::swap(left_, other.left_);
+    std::swap(used_, other.used_);
+    std::swap(reserved_, other.reserved_);
+}
+
+inline size_t KeyArena::usedBytes() const
+{
+    return used_;
+}
+
+inline size_t KeyArena::reservedBytes() const
+{
+    return reserved_;
+}
+
+/**
+ * Number of leading bytes a and b have in common, looking at most n.
+ * Compares a word at a time where the byte order allows it.
+ */
+inline size_t prefixMismatch(const char* a, const char* b, size_t n)
+{
+    size_t i = 0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+        }
+    }
+#endif
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * A string key in three pieces: a head borrowed from the arena bytes of
+ * another key that starts the same way (or stored whole if none does),
+ * then the key's own tail, whose first PREFIX_INLINE_BYTES live in the
+ * key and the rest in the arena. A lookup that gets past the head is
+ * usually settled by the inline bytes without leaving the node.
+ * Compares like std::string.
+ */
+class PrefixKey
+{
+public:
+    PrefixKey();
+    PrefixKey(const char* head, uint32_t headLen, const char* tail, uint32_t tailLen, KeyArena& arena);
+
+    size_t size() const;
+    size_t headSize() const;
+    char operator[](size_t i) const;
+    std::string str() const;
+
+    int compareString(const char* s, size_t n, size_t& lcp) const;
+    int compare(const PrefixKey& other) const;
+    bool operator<(const PrefixKey& rhs) const;
+    bool operator>(const PrefixKey& rhs) const;
+    bool operator==(const PrefixKey& rhs) const;
+    bool operator!=(const PrefixKey& rhs) const;
+
+protected:
+    template <typename Value> friend class PrefixStringTree;
+
+    size_t inlineSize() const;
+    static int comparePiece(const char* s, const char* piece, size_t from, size_t to, size_t limit, size_t& i);
+
+    // Node keys are const; PrefixStringTree::compactKeys() moves their
+    // bytes without changing what they spell.
+    void rebind(const PrefixKey& moved) const;
+
+    mutable const char* head_;
+    mutable const char* rest_;      // tail bytes past the inline ones
+    mutable uint32_t headLen_;
+    mutable uint32_t tailLen_;
+    mutable char inline_[PREFIX_INLINE_BYTES];
+};
+
+inline PrefixKey::PrefixKey() : head_(NULL), rest_(NULL), headLen_(0), tailLen_(0)
+{
+    memset(inline_, 0, sizeof(inline_));
+}
+
+/**
+ * head must already be in the arena; the tail is copied, into the key
+ * as far as it fits and into arena after that.
+ */
+inline PrefixKey::PrefixKey(const char* head, uint32_t headLen, const char* tail, uint32_t tailLen, KeyArena& arena) :
+    head_(head), rest_(NULL), headLen_(headLen), tailLen_(tailLen)
+{
+    size_t inlined = inlineSize();
+    memset(inline_, 0, sizeof(inline_));
+    if (inlined > 0) {
+        memcpy(inline_, tail, inlined);
+    }
+    if (tailLen > inlined) {
+        rest_ = arena.store(tail + inlined, tailLen - inlined);
+    }
+}
+
+inline size_t PrefixKey::size() const
+{
+    return size_t(headLen_) + tailLen_;
+}
+
+/**
+ * Length of the head, the part another key can borrow.
+ */
+inline size_t PrefixKey::headSize() const
+{
+    return headLen_;
+}
+
+inline size_t PrefixKey::inlineSize() const
+{
+    return std::min<size_t>(tailLen_, PREFIX_INLINE_BYTES);
+}
+
+inline char PrefixKey::operator[](size_t i) const
+{
+    if (i < headLen_) {
+        return head_[i];
+    }
+    i -= headLen_;
+    return i < PREFIX_INLINE_BYTES ? inline_[i] : rest_[i - PREFIX_INLINE_BYTES];
+}
+
+inline std::string PrefixKey::str() const
+{
+    std::string s(head_, headLen_);
+    s.append(inline_, inlineSize());
+    if (rest_ != NULL) {
+        s.append(rest_, tailLen_ - PREFIX_INLINE_BYTES);
+    }
+    return s;
+}
+
+/**
+ * Compares s with the piece of a key holding its bytes [from, to),
+ * starting at byte i and stopping at limit. Advances i past the bytes
+ * that match and returns nonzero at the first one that does not.
+ */
+inline int PrefixKey::comparePiece(const char* s, const char* piece, size_t from, size_t to, size_t limit, size_t& i)
+{
+    size_t end = std::min(to, limit);
+    if (i >= end) {
+        return 0;
+    }
+    i += prefixMismatch(s + i, piece + (i - from), end - i);
+    if (i == end) {
+        return 0;
+    }
+    return static_cast<unsigned char>(s[i]) < static_cast<unsigned char>(piece[i - from]) ? -1 : 1;
+}
+
+/**
+ * Compares s (n bytes) with this key, negative if s sorts first, skipping
+ * the first lcp bytes, which the caller knows to be equal. Leaves the
+ * length of their common prefix in lcp. Pieces wholly inside lcp are
+ * not read at all.
+ */
+inline int PrefixKey::compareString(const char* s, size_t n, size_t& lcp) const
+{
+    const size_t len = size();
+    const size_t limit = std::min(n, len);
+    const size_t inlineEnd = headLen_ + inlineSize();
+    size_t i = lcp;
+    int c = comparePiece(s, head_, 0, headLen_, limit, i);
+    if (c == 0) {
+        c = comparePiece(s, inline_, headLen_, inlineEnd, limit, i);
+    }
+    if (c == 0) {
+        c = comparePiece(s, rest_, inlineEnd, len, limit, i);
+    }
+    lcp = i;
+    if (c != 0) {
+        return c;
+    }
+    return n < len ? -1 : n > len ? 1 : 0;
+}
+
+inline int PrefixKey::compare(const PrefixKey& other) const
+{
+    size_t n = std::min(size(), other.size());
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char a = static_cast<unsigned char>((*this)[i]);
+        unsigned char b = static_cast<unsigned char>(other[i]);
+        if (a != b) {
+            return a < b ? -1 : 1;
+        }
+    }
+    return size() < other.size() ? -1 : size() > other.size() ? 1 : 0;
+}
+
+inline bool PrefixKey::operator<(const PrefixKey& rhs) const
+{
+    return compare(rhs) < 0;
+}
+
+inline bool PrefixKey::operator>(const PrefixKey& rhs) const
+{
+    return compare(rhs) > 0;
+}
+
+inline bool PrefixKey::operator==(const PrefixKey& rhs) const
+{
+    return compare(rhs) == 0;
+}
+
+inline bool PrefixKey::operator!=(const PrefixKey& rhs) const
+{
+    return compare(rhs) != 0;
+}
+
+inline void PrefixKey::rebind(const PrefixKey& moved) const
+{
+    head_ = moved.head_;
+    rest_ = moved.rest_;
+    headLen_ = moved.headLen_;
+    tailLen_ = moved.tailLen_;
+    memcpy(inline_, moved.inline_, PREFIX_INLINE_BYTES);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const PrefixKey& key)
+{
+    for (size_t i = 0; i < key.size(); ++i) {
+        os << key[i];
+    }
+    return os;
+}
+
+/**
+ * An AVLTree for std::string keys with heavily shared prefixes, such as
+ * paths. Keys live in one arena instead of one heap block each, and a
+ * new key borrows as much of its head as it can from whichever of its
+ * future neighbours shares the longer prefix, storing only the rest.
+ *
+ * Lookups track how many leading bytes the search key shares with the
+ * nearest bounds on each side. Every key in between shares at least the
+ * smaller of the two, so each comparison starts past it instead of
+ * rescanning the common prefix.
+ *
+ * Removed keys' bytes stay in the arena (other keys may borrow them)
+ * until compactKeys(), which runs by itself once more keys have been
+ * removed than are left. Keys point into this tree's arena, so the
+ * AVLTree base is private: only the string overloads and the calls that
+ * take no key are offered, and no PrefixKey from elsewhere can get in.
+ */
+template <typename Value>
+class PrefixStringTree : private AVLTree<PrefixKey, Value>
+{
+public:
+    typedef AVLTree<PrefixKey, Value> Base;
+    typedef typename Base::iterator iterator;
+
+    PrefixStringTree();
+    virtual ~PrefixStringTree();
+
+    std::pair<iterator, bool> insert(const std::string& key, const Value& value);
+    std::pair<iterator, bool> insert(const std::pair<std::string, Value>& item);
+    iterator find(const std::string& key) const;
+    void remove(const std::string& key);
+    Value& operator[](const std::string& key);
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    void compactKeys();
+    size_t keyBytes() const;
+
+    using Base::clear;
+    using Base::compact;
+    using Base::begin;
+    using Base::end;
+    using Base::empty;
+    using Base::size;
+    using Base::isBalanced;
+    using Base::validate;
+    using Base::print;
+    using Base::memory_usage;
+
+protected:
+    void keyRemoved();
+    Node<PrefixKey, Value>* locateString(const char* s, size_t n, Node<PrefixKey, Value>*& parent, bool& left,
+                                         const PrefixKey*& neighbour, size_t& shared) const;
+    PrefixKey encode(const char* s, size_t n, const PrefixKey* neighbour, size_t shared, KeyArena& arena) const;
+    virtual void clearHelper(Node<PrefixKey, Value>* node) override;
+    virtual size_t auxiliaryBytes() const override;
+
+    KeyArena keys_;
+    size_t removed_;    // keys removed since the last compactKeys()
+};
+
+template<class Value>
+PrefixStringTree<Value>::PrefixStringTree() : removed_(0)
+{
+
+}
+
+/**
+ * Frees the nodes while the arena their keys point into still exists.
+ */
+template<class Value>
+PrefixStringTree<Value>::~PrefixStringTree()
+{
+    this->clear();
+}
+
+/**
+ * Descends as locate() does, comparing from the prefix shared with both
+ * bounds. On a miss also returns, in neighbour and shared, the bound
+ * sharing the longer prefix with s and that prefix's length.
+ */
+template<class Value>
+Node<PrefixKey, Value>* PrefixStringTree<Value>::locateString(const char* s, size_t n, Node<PrefixKey, Value>*& parent,
+                                                              bool& left, const PrefixKey*& neighbour, size_t& shared) const
+{
+    Node<PrefixKey, Value>* current = this->root_;
+    const PrefixKey* lower = NULL;
+    const PrefixKey* upper = NULL;
+    size_t lowerLcp = 0, upperLcp = 0;
+    parent = NULL;
+    left = false;
+    while (current != NULL) {
+        size_t lcp = std::min(lowerLcp, upperLcp);
+        int c = current->getKey().compareString(s, n, lcp);
+        if (c == 0) {
+            return current;
+        }
+        parent = current;
+        left = c < 0;
+        if (left) {
+            upper = &current->getKey();
+            upperLcp = lcp;
+            current = current->getLeft();
+        }
+        else {
+            lower = &current->getKey();
+            lowerLcp = lcp;
+            current = current->getRight();
+        }
+    }
+    neighbour = lowerLcp >= upperLcp ? lower : upper;
+    shared = std::max(lowerLcp, upperLcp);
+    return NULL;
+}
+
+/**
+ * Stores s in arena, borrowing the head of neighbour, with which it
+ * shares `shared` bytes, when that saves at least PREFIX_MIN_SHARED.
+ * A key can only borrow a head, not the neighbour's own tail.
+ */
+template<class Value>
+PrefixKey PrefixStringTree<Value>::encode(const char* s, size_t n, const PrefixKey* neighbour, size_t shared,
+                                          KeyArena& arena) const
+{
+    size_t borrow = neighbour != NULL ? std::min(shared, neighbour->headSize()) : 0;
+    // also store whole a key that shares much more than the neighbour's
+    // head can lend, so that the keys after it can borrow the longer head
+    if (borrow < PREFIX_MIN_SHARED || shared - borrow >= PREFIX_MIN_SHARED) {
+        return PrefixKey(arena.store(s, n), uint32_t(n), s + n, 0, arena);
+    }
+    return PrefixKey(neighbour->head_, uint32_t(borrow), s + borrow, uint32_t(n - borrow), arena);
+}
+
+template<class Value>
+std::pair<typename PrefixStringTree<Value>::iterator, bool>
+PrefixStringTree<Value>::insert(const std::string& key, const Value& value)
+{
+    Node<PrefixKey, Value>* parent;
+    bool left;
+    const PrefixKey* neighbour;
+    size_t shared;
+    Node<PrefixKey, Value>* existing = locateString(key.data(), key.size(), parent, left, neighbour, shared);
+    if (existing != NULL) {
+        this->assignValue(existing, value);
+        return std::make_pair(this->iteratorFor(existing), false);
+    }
+    PrefixKey stored = encode(key.data(), key.size(), neighbour, shared, keys_);
+    return std::make_pair(this->iteratorFor(this->attachNode(parent, left, stored, value)), true);
+}
+
+template<class Value>
+std::pair<typename PrefixStringTree<Value>::iterator, bool>
+PrefixStringTree<Value>::insert(const std::pair<std::string, Value>& item)
+{
+    return insert(item.first, item.second);
+}
+
+template<class Value>
+typename PrefixStringTree<Value>::iterator PrefixStringTree<Value>::find(const std::string& key) const
+{
+    Node<PrefixKey, Value>* parent;
+    bool left;
+    const PrefixKey* neighbour;
+    size_t shared;
+    return this->iteratorFor(locateString(key.data(), key.size(), parent, left, neighbour, shared));
+}
+
+template<class Value>
+void PrefixStringTree<Value>::remove(const std::string& key)
+{
+    Node<PrefixKey, Value>* parent;
+    bool left;
+    const PrefixKey* neighbour;
+    size_t shared;
+    Node<PrefixKey, Value>* node = locateString(key.data(), key.size(), parent, left, neighbour, shared);
+    if (node == NULL) {
+        return;
+    }
+    this->removeNode(node);
+    keyRemoved();
+}
+
+/**
+ * Removes the key at pos, which must be valid, and returns an iterator
+ * to the key after it.
+ */
+template<class Value>
+typename PrefixStringTree<Value>::iterator PrefixStringTree<Value>::erase(iterator pos)
+{
+    iterator next = Base::erase(pos);
+    keyRemoved();
+    return next;
+}
+
+template<class Value>
+typename PrefixStringTree<Value>::iterator PrefixStringTree<Value>::erase(iterator first, iterator last)
+{
+    while (first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+/**
+ * Counts a removal and compacts the arena once more keys have been
+ * removed than are left. compactKeys() keeps iterators valid.
+ */
+template<class Value>
+void PrefixStringTree<Value>::keyRemoved()
+{
+    if (++removed_ > this->size_) {
+        compactKeys();
+    }
+}
+
+template<class Value>
+Value& PrefixStringTree<Value>::operator[](const std::string& key)
+{
+    Node<PrefixKey, Value>* parent;
+    bool left;
+    const PrefixKey* neighbour;
+    size_t shared;
+    Node<PrefixKey, Value>* node = locateString(key.data(), key.size(), parent, left, neighbour, shared);
+    if (node == NULL) {
+        node = this->attachNode(parent, left, encode(key.data(), key.size(), neighbour, shared, keys_), Value());
+    }
+    return node->getValue();
+}
+
+/**
+ * Rewrites every key into a fresh arena in key order, each borrowing from
+ * its predecessor, which drops the bytes of removed keys. Iterators stay
+ * valid.
+ */
+template<class Value>
+void PrefixStringTree<Value>::compactKeys()
+{
+    KeyArena fresh;
+    std::string previous, current;
+    const PrefixKey* prevKey = NULL;
+    for (iterator it = this->iteratorFor(this->getSmallestNode()); it != this->end(); ++it) {
+        const PrefixKey& key = it->first;
+        current = key.str();
+        size_t shared = 0;
+        size_t limit = std::min(previous.size(), current.size());
+        while (shared < limit && previous[shared] == current[shared]) {
+            shared++;
+        }
+        key.rebind(encode(current.data(), current.size(), prevKey, shared, fresh));
+        previous.swap(current);
+        prevKey = &key;
+    }
+    keys_.swap(fresh);
+    removed_ = 0;
+}
+
+/**
+ * Arena bytes holding key data, removed keys included.
+ */
+template<class Value>
+size_t PrefixStringTree<Value>::keyBytes() const
+{
+    return keys_.usedBytes();
+}
+
+template<class Value>
+void PrefixStringTree<Value>::clearHelper(Node<PrefixKey, Value>* node)
+{
+    AVLTree<PrefixKey, Value>::clearHelper(node);
+    keys_.clear();
+    removed_ = 0;
+}
+
+template<class Value>
+size_t PrefixStringTree<Value>::auxiliaryBytes() const
+{
+    return keys_.reservedBytes();
+}
+
+#endif
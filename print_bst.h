@@ -11,6 +11,7 @@
 // Version 1.2
 
 // maximum depth of tree to actually print.
+// (export_bst.h dumps trees of any size to any stream.)
 #define PPBST_MAX_HEIGHT 6
 
 // Returns the node's distance from the given root.
@@ -63,6 +64,25 @@ int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
                     getSubtreeHeight(root->getRight(), recursionDepth + 1)) + 1;
 }
 
+// Writes a key or value for the placeholder legend. Pairs (e.g. the
+// interval keys of IntervalTree) have no operator<<, so print them as
+// (first, second).
+template<typename T>
+void ppbstPrintItem(std::ostream & os, T const & item)
+{
+    os << item;
+}
+
+template<typename A, typename B>
+void ppbstPrintItem(std::ostream & os, std::pair<A, B> const & item)
+{
+    os << '(';
+    ppbstPrintItem(os, item.first);
+    os << ", ";
+    ppbstPrintItem(os, item.second);
+    os << ')';
+}
+
 /* Function to prettily print a BST out to the terminal.
 
    Output should look a bit like this:
@@ -271,7 +291,9 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
             // print element with original cout flags
             std::cout.flags(origCoutState);
-            std::cout << '(' << placeholdersIter->first << ", ";
+            std::cout << '(';
+            ppbstPrintItem(std::cout, placeholdersIter->first);
+            std::cout << ", ";
 
             typename BinarySearchTree<Key, Value>::iterator elementIter = this->find(placeholdersIter->first);
             if(elementIter == this->end())
@@ -280,7 +302,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
             }
             else
             {
-                std::cout << elementIter->second;
+                ppbstPrintItem(std::cout, elementIter->second);
             }
 
             std::cout << ')' << std::endl;
@@ -0,0 +1,233 @@
+// Replays an operation trace (trace.h) against several tree types and
+// reports throughput and per-operation latency percentiles.
+//
+//   make replay
+//   ./replay trace.bin [--scan n] [tree ...]
+//   ./replay --record trace.bin [ops] [keys]
+//
+// Trees are bst, avl, pooled, filtered and checkpointed (default: all).
+// Each traced key hash becomes a uint64_t key, so repeats and the
+// operation mix are reproduced but key order is not. Preloaded keys are
+// inserted untimed first; every other record is then timed on its own,
+// back to back, ignoring the recorded gaps. A scan is replayed as
+// begin() or lower_bound() followed by n steps (default 16).
+//
+// --record writes a synthetic trace: a skewed mix of finds, inserts,
+// removes and scans on an AVLTree holding about half of `keys` keys.
+//
+// Build with DEFS=-DLATENCY_USE_RDTSC to time with rdtsc.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "bst.h"
+#include "avlbst.h"
+#include "nodepool.h"
+#include "filteredavl.h"
+#include "checkpointavl.h"
+#include "latency.h"
+#include "trace.h"
+#include "benchrand.h"
+
+using namespace std;
+
+static const char* opNames[] = { "insert", "find", "remove", "iterate" };
+static const int NUM_OPS = 4;
+
+static int record(const char* path, uint64_t ops, uint64_t keys)
+{
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "replay: cannot open " << path << endl;
+        return 1;
+    }
+    uint64_t state = 2463534242ull;
+    AVLTree<uint64_t, uint64_t> tree;
+    for (uint64_t i = 0; i < keys / 2; ++i) {
+        uint64_t k = nextRand(state) % keys;
+        tree.insert(make_pair(k, k));
+    }
+
+    TraceRecorder recorder(out);
+    tree.setRecorder(&recorder);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; ++i) {
+        uint64_t r = nextRand(state);
+        // skewed toward low keys: a uniform pick below a uniform bound
+        uint64_t k = nextRand(state) % (r % keys + 1);
+        switch (r % 20) {
+        case 0: case 1: case 2: case 3: case 4:
+            tree.insert(make_pair(k, i));
+            break;
+        case 5: case 6: case 7:
+            tree.remove(k);
+            break;
+        case 8: case 9: {
+            AVLTree<uint64_t, uint64_t>::iterator it = tree.lower_bound(k);
+            for (int j = 0; j < 16 && it != tree.end(); ++j, ++it) {
+                sum += it->second;
+            }
+            break;
+        }
+        default:
+            if (tree.find(k) != tree.end()) {
+                sum++;
+            }
+            break;
+        }
+    }
+    tree.setRecorder(NULL);
+    recorder.flush();
+    cout << recorder.records() << " records, " << recorder.bytes() << " bytes ("
+         << fixed << setprecision(2) << double(recorder.bytes()) / recorder.records()
+         << " per record) in " << path << " [" << sum % 10 << "]" << endl;
+    return 0;
+}
+
+template<typename Tree>
+static void replayOn(const char* name, const vector<TraceRecord>& trace, size_t scan, const LatencyClock& clock)
+{
+    Tree tree;
+    LatencyHistogram hist[NUM_OPS];
+    uint64_t sum = 0;
+    uint64_t timed = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        const TraceRecord& r = trace[i];
+        if (r.flags & TRACE_PRELOAD) {
+            tree.insert(make_pair(r.keyHash, uint64_t(i)));
+            continue;
+        }
+
+        uint64_t start = clock.now();
+        switch (r.op) {
+        case TRACE_INSERT:
+            tree.insert(make_pair(r.keyHash, uint64_t(i)));
+            break;
+        case TRACE_FIND:
+            sum += tree.find(r.keyHash) != tree.end();
+            break;
+        case TRACE_REMOVE:
+            tree.remove(r.keyHash);
+            break;
+        case TRACE_ITERATE: {
+            typename Tree::iterator it = (r.flags & TRACE_FROM_START) ? tree.begin() : tree.lower_bound(r.keyHash);
+            for (size_t j = 0; j < scan && it != tree.end(); ++j, ++it) {
+                sum += it->second;
+            }
+            break;
+        }
+        default:
+            continue;
+        }
+        uint64_t ns = clock.toNanos(clock.now() - start);
+        hist[r.op].record(ns);
+        total += ns;
+        timed++;
+    }
+
+    cout << "\n" << name << ": " << timed << " ops in " << fixed << setprecision(1) << total / 1e6 << " ms, "
+         << setprecision(2) << (total == 0 ? 0.0 : timed / (total / 1e9) / 1e6) << " Mops/s"
+         << " [" << sum % 10 << "]" << endl;
+    cout << setw(10) << "op" << setw(11) << "count" << setw(9) << "mean" << setw(8) << "p50"
+         << setw(8) << "p90" << setw(8) << "p99" << setw(9) << "p999" << setw(10) << "max" << endl;
+    for (int op = 0; op < NUM_OPS; ++op) {
+        if (hist[op].count() == 0) {
+            continue;
+        }
+        cout << setw(10) << opNames[op] << setw(11) << hist[op].count() << setprecision(0)
+             << setw(9) << hist[op].mean() << setw(8) << hist[op].percentile(50)
+             << setw(8) << hist[op].percentile(90) << setw(8) << hist[op].percentile(99)
+             << setw(9) << hist[op].percentile(99.9) << setw(10) << hist[op].max() << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2 && strcmp(argv[1], "--record") == 0) {
+        uint64_t ops = argc > 3 ? strtoull(argv[3], NULL, 10) : 2000000;
+        uint64_t keys = argc > 4 ? strtoull(argv[4], NULL, 10) : 1000000;
+        return record(argv[2], ops, keys);
+    }
+    if (argc < 2) {
+        cerr << "usage: replay trace.bin [--scan n] [bst|avl|pooled|filtered|checkpointed ...]" << endl;
+        cerr << "       replay --record trace.bin [ops] [keys]" << endl;
+        return 1;
+    }
+
+    size_t scan = 16;
+    vector<string> trees;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--scan") == 0 && i + 1 < argc) {
+            scan = strtoull(argv[++i], NULL, 10);
+        }
+        else {
+            trees.push_back(argv[i]);
+        }
+    }
+    if (trees.empty()) {
+        const char* all[] = { "bst", "avl", "pooled", "filtered", "checkpointed" };
+        trees.assign(all, all + 5);
+    }
+
+    ifstream in(argv[1], ios::binary);
+    if (!in) {
+        cerr << "replay: cannot open " << argv[1] << endl;
+        return 1;
+    }
+    vector<TraceRecord> trace;
+    uint64_t preload = 0, first = 0, last = 0;
+    try {
+        TraceReader reader(in);
+        TraceRecord r;
+        while (reader.next(r)) {
+            if (r.flags & TRACE_PRELOAD) {
+                preload++;
+            }
+            else {
+                first = trace.size() == preload ? r.nanos : first;
+                last = r.nanos;
+            }
+            trace.push_back(r);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "replay: " << argv[1] << ": " << e.what() << endl;
+        return 1;
+    }
+
+    LatencyClock clock;
+    uint64_t ops = trace.size() - preload;
+    cout << trace.size() << " records (" << preload << " preloaded), recorded at "
+         << fixed << setprecision(2) << (last > first ? ops / ((last - first) / 1e9) / 1e6 : 0.0)
+         << " Mops/s; timing with " << clock.source() << ", scans of " << scan << endl;
+
+    for (size_t t = 0; t < trees.size(); ++t) {
+        const string& name = trees[t];
+        if (name == "bst") {
+            replayOn<BinarySearchTree<uint64_t, uint64_t> >("bst", trace, scan, clock);
+        }
+        else if (name == "avl") {
+            replayOn<AVLTree<uint64_t, uint64_t> >("avl", trace, scan, clock);
+        }
+        else if (name == "pooled") {
+            replayOn<PooledAVLTree<uint64_t, uint64_t> >("pooled", trace, scan, clock);
+        }
+        else if (name == "filtered") {
+            replayOn<FilteredAVLTree<uint64_t, uint64_t> >("filtered", trace, scan, clock);
+        }
+        else if (name == "checkpointed") {
+            replayOn<CheckpointedAVLTree<uint64_t, uint64_t> >("checkpointed", trace, scan, clock);
+        }
+        else {
+            cerr << "replay: unknown tree " << name << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Write throughput of ShardedTree vs. one AVLTree behind one mutex, as
+// the number of writer threads grows.
+//
+//   make sharded-bench
+//   ./sharded-bench [writes] [shards] [max-threads]
+//
+// Every thread inserts its share of uniformly random keys; the sharded
+// map starts with evenly spaced splits.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+#include <cstdlib>
+#include "shardedtree.h"
+#include "benchrand.h"
+
+using namespace std;
+
+static const uint64_t KEY_SPACE = 1ull << 40;
+
+template <typename Insert>
+static double timeWriters(unsigned threads, uint64_t writes, Insert insert)
+{
+    vector<thread> workers;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.push_back(thread([=]() {
+            uint64_t state = 104 + t * 7919;
+            for (uint64_t i = 0; i < writes / threads; ++i) {
+                uint64_t k = nextRand(state) % KEY_SPACE;
+                insert(k);
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t writes = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+    size_t shards = argc > 2 ? strtoull(argv[2], NULL, 10) : 16;
+    unsigned maxThreads = argc > 3 ? atoi(argv[3]) : 8;
+
+    vector<uint64_t> splits;
+    for (size_t i = 1; i < shards; ++i) {
+        splits.push_back(KEY_SPACE / shards * i);
+    }
+
+    cout << writes << " writes, " << shards << " shards, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << setw(8) << "threads" << setw(16) << "locked Mops/s" << setw(16) << "sharded Mops/s" << endl;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        AVLTree<uint64_t, uint64_t> single;
+        mutex lock;
+        double lockedSec = timeWriters(threads, writes, [&](uint64_t k) {
+            lock_guard<mutex> guard(lock);
+            single.insert(make_pair(k, k));
+        });
+
+        ShardedTree<uint64_t, uint64_t> sharded(splits);
+        double shardedSec = timeWriters(threads, writes, [&](uint64_t k) {
+            sharded.insert(make_pair(k, k));
+        });
+
+        if (sharded.size() != single.size()) {
+            cerr << "sharded-bench: sharded and locked trees disagree" << endl;
+            return 1;
+        }
+        cout << setw(8) << threads << fixed << setprecision(2)
+             << setw(16) << writes / lockedSec / 1e6 << setw(16) << writes / shardedSec / 1e6 << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,491 @@
+#ifndef SHARDEDTREE_H
+#define SHARDEDTREE_H
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "nodepool.h"
+
+/**
+ * An ordered map split into range shards so that writers on different
+ * cores do not serialise on one tree.
+ *
+ * Shard i holds the keys in [split i-1, split i). Every shard is its own
+ * PooledAVLTree with its own mutex and node pool; insert(), remove() and
+ * get() lock only the shard that owns the key.
+ *
+ * When an insert grows a shard past skewLimit times the average shard
+ * size, or a remove shrinks one below the average over skewLimit, the
+ * split keys are moved to even quantiles. That briefly locks every shard
+ * and only moves the keys that change shard. A map built with just a
+ * shard count starts with everything in shard 0 and picks its splits on
+ * the first such rebalance.
+ *
+ * find(), lower_bound() and iteration walk the shards in order without
+ * locking; use them only while no thread is writing.
+ */
+template <typename Key, typename Value>
+class ShardedTree
+{
+public:
+    typedef std::pair<const Key, Value> Item;
+    typedef PooledAVLTree<Key, Value> Tree;
+
+    explicit ShardedTree(size_t shards);
+    explicit ShardedTree(const std::vector<Key>& splits);
+
+    bool insert(const Item& keyValuePair);
+    void remove(const Key& key);
+    bool get(const Key& key, Value& out) const;
+    void clear();
+    void rebalanceShards();
+    void setSkewLimit(double skewLimit);
+    bool validate() const;
+    void print() const;
+    bool empty() const;
+    size_t size() const;
+    size_t shardCount() const;
+    size_t shardSize(size_t shard) const;
+
+    /**
+    * Walks the shards in key order, moving to the next non-empty shard
+    * when one runs out.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        Item& operator*() const;
+        Item* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedTree<Key, Value>;
+        iterator(const ShardedTree<Key, Value>* owner, size_t shard, typename Tree::iterator it);
+        void skipEmpty();
+
+        const ShardedTree<Key, Value>* owner_;
+        size_t shard_;
+        typename Tree::iterator it_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+
+protected:
+    struct Shard {
+        mutable std::mutex lock;
+        Tree tree;
+    };
+    typedef std::vector<Key> Splits;
+
+    static size_t shardFor(const Splits& splits, const Key& key);
+    size_t lockShardFor(const Key& key, std::unique_lock<std::mutex>& guard) const;
+    void maybeRebalance(size_t shardSize);
+    void moveOutOfRange(size_t shard, const Splits& splits);
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    // Swapped whole under every shard lock; readers load it, lock the
+    // shard it names and check that it is still current.
+    std::shared_ptr<const Splits> splits_;
+    std::atomic<size_t> size_;
+    std::mutex rebalanceLock_;
+    // Read by every writer, so setSkewLimit() may run at any time.
+    std::atomic<double> skewLimit_;
+};
+
+/*
+----------------------------------------------------------
+Begin implementations for the ShardedTree::iterator class.
+----------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ShardedTree<Key, Value>::iterator::iterator() : owner_(NULL), shard_(0)
+{
+
+}
+
+template<class Key, class Value>
+ShardedTree<Key, Value>::iterator::iterator(const ShardedTree<Key, Value>* owner, size_t shard,
+                                            typename Tree::iterator it) :
+    owner_(owner), shard_(shard), it_(it)
+{
+    skipEmpty();
+}
+
+/**
+ * Steps over shard ends; the overall end is (shard count, tree end).
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::iterator::skipEmpty()
+{
+    while (shard_ < owner_->shards_.size() && it_ == owner_->shards_[shard_]->tree.end()) {
+        shard_++;
+        if (shard_ < owner_->shards_.size()) {
+            it_ = owner_->shards_[shard_]->tree.begin();
+        }
+    }
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& ShardedTree<Key, Value>::iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* ShardedTree<Key, Value>::iterator::operator->() const
+{
+    return &(*it_);
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return shard_ == rhs.shard_ && it_ == rhs.it_;
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator&
+ShardedTree<Key, Value>::iterator::operator++()
+{
+    ++it_;
+    skipEmpty();
+    return *this;
+}
+
+/*
+--------------------------------------------------------
+End implementations for the ShardedTree::iterator class.
+--------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ShardedTree<Key, Value>::ShardedTree(size_t shards) :
+    splits_(std::make_shared<const Splits>()), size_(0), skewLimit_(1.5)
+{
+    if (shards == 0) {
+        throw std::invalid_argument("ShardedTree needs at least one shard");
+    }
+    for (size_t i = 0; i < shards; ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+/**
+ * Starts with the given split keys, which must be strictly increasing;
+ * n splits make n + 1 shards.
+ */
+template<class Key, class Value>
+ShardedTree<Key, Value>::ShardedTree(const std::vector<Key>& splits) :
+    splits_(std::make_shared<const Splits>(splits)), size_(0), skewLimit_(1.5)
+{
+    for (size_t i = 0; i <= splits.size(); ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::shardFor(const Splits& splits, const Key& key)
+{
+    return std::upper_bound(splits.begin(), splits.end(), key) - splits.begin();
+}
+
+/**
+ * Locks the shard that owns key and returns its index. Retries if the
+ * splits moved between reading them and taking the lock.
+ */
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::lockShardFor(const Key& key, std::unique_lock<std::mutex>& guard) const
+{
+    for (;;) {
+        std::shared_ptr<const Splits> splits = std::atomic_load(&splits_);
+        size_t shard = shardFor(*splits, key);
+        guard = std::unique_lock<std::mutex>(shards_[shard]->lock);
+        if (std::atomic_load(&splits_) == splits) {
+            return shard;
+        }
+        guard.unlock();
+    }
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is present.
+ * Returns true if the key was new. Safe to call from any thread.
+ */
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::insert(const Item& keyValuePair)
+{
+    std::unique_lock<std::mutex> guard;
+    size_t shard = lockShardFor(keyValuePair.first, guard);
+    Tree& tree = shards_[shard]->tree;
+    bool created = tree.insert(keyValuePair).second;
+    size_t shardSize = tree.size();
+    guard.unlock();
+
+    if (created) {
+        size_++;
+        maybeRebalance(shardSize);
+    }
+    return created;
+}
+
+/**
+ * Safe to call from any thread.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::remove(const Key& key)
+{
+    std::unique_lock<std::mutex> guard;
+    size_t shard = lockShardFor(key, guard);
+    Tree& tree = shards_[shard]->tree;
+    typename Tree::iterator it = tree.find(key);
+    if (it == tree.end()) {
+        return;
+    }
+    tree.erase(it);
+    size_t shardSize = tree.size();
+    guard.unlock();
+
+    size_--;
+    maybeRebalance(shardSize);
+}
+
+/**
+ * Copies the key's value into out and returns true, or returns false if
+ * the key is missing. Safe to call from any thread.
+ */
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::get(const Key& key, Value& out) const
+{
+    std::unique_lock<std::mutex> guard;
+    size_t shard = lockShardFor(key, guard);
+    const Tree& tree = shards_[shard]->tree;
+    typename Tree::iterator it = tree.find(key);
+    if (it == tree.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+template<class Key, class Value>
+void ShardedTree<Key, Value>::clear()
+{
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        shards_[i]->tree.clear();
+    }
+    size_ = 0;
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::shardCount() const
+{
+    return shards_.size();
+}
+
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::shardSize(size_t shard) const
+{
+    std::lock_guard<std::mutex> guard(shards_[shard]->lock);
+    return shards_[shard]->tree.size();
+}
+
+/**
+ * Sets how many times the average shard size one shard may reach before
+ * the splits are moved; 0 turns automatic rebalancing off.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::setSkewLimit(double skewLimit)
+{
+    skewLimit_.store(skewLimit, std::memory_order_relaxed);
+}
+
+/**
+ * Called after an insert or remove left a shard at shardSize: rebalances
+ * if that shard is now over skewLimit times the average, or under the
+ * average over skewLimit. Small shards and maps are left alone, and only
+ * one thread rebalances at a time.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::maybeRebalance(size_t shardSize)
+{
+    const size_t minShard = 1024;
+    double skewLimit = skewLimit_.load(std::memory_order_relaxed);
+    if (skewLimit <= 0 || shards_.size() < 2) {
+        return;
+    }
+    double average = (double)size_ / (double)shards_.size();
+    bool over = shardSize >= minShard && (double)shardSize > skewLimit * average;
+    bool under = average >= minShard && (double)shardSize * skewLimit < average;
+    if (!over && !under) {
+        return;
+    }
+    std::unique_lock<std::mutex> guard(rebalanceLock_, std::try_to_lock);
+    if (guard.owns_lock()) {
+        rebalanceShards();
+    }
+}
+
+/**
+ * Moves the splits to even quantiles of the current keys and moves each
+ * key whose shard changed. Holds every shard lock, in shard order.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::rebalanceShards()
+{
+    std::vector<std::unique_lock<std::mutex> > guards;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        guards.push_back(std::unique_lock<std::mutex>(shards_[i]->lock));
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        total += shards_[i]->tree.size();
+    }
+    const size_t count = shards_.size();
+    std::shared_ptr<Splits> splits = std::make_shared<Splits>();
+    size_t rank = 0;
+    size_t next = 1;
+    for (iterator it = begin(); it != end() && next < count; ++it, ++rank) {
+        if (rank == next * total / count) {
+            if (splits->empty() || splits->back() < it->first) {
+                splits->push_back(it->first);
+            }
+            next++;
+        }
+    }
+    if (splits->size() + 1 != count) {
+        // too few distinct keys to fill every shard; keep the old splits
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        moveOutOfRange(i, *splits);
+    }
+    std::atomic_store(&splits_, std::shared_ptr<const Splits>(splits));
+}
+
+/**
+ * Moves the keys of shard below its new lower split or at/above its new
+ * upper split into the shards that now own them. Every key moved lands
+ * inside its new shard's range, so it is never moved twice.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::moveOutOfRange(size_t shard, const Splits& splits)
+{
+    Tree& tree = shards_[shard]->tree;
+    if (shard > 0) {
+        typename Tree::iterator last = tree.lower_bound(splits[shard - 1]);
+        for (typename Tree::iterator it = tree.begin(); it != last; ) {
+            shards_[shardFor(splits, it->first)]->tree.insert(*it);
+            it = tree.erase(it);
+        }
+    }
+    if (shard + 1 < shards_.size()) {
+        for (typename Tree::iterator it = tree.lower_bound(splits[shard]); it != tree.end(); ) {
+            shards_[shardFor(splits, it->first)]->tree.insert(*it);
+            it = tree.erase(it);
+        }
+    }
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator ShardedTree<Key, Value>::begin() const
+{
+    return iterator(this, 0, shards_[0]->tree.begin());
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator ShardedTree<Key, Value>::end() const
+{
+    return iterator(this, shards_.size(), typename Tree::iterator());
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator ShardedTree<Key, Value>::find(const Key& key) const
+{
+    size_t shard = shardFor(*splits_, key);
+    typename Tree::iterator it = shards_[shard]->tree.find(key);
+    if (it == shards_[shard]->tree.end()) {
+        return end();
+    }
+    return iterator(this, shard, it);
+}
+
+/**
+ * The first key not less than key, continuing into later shards if the
+ * owning shard has none.
+ */
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator ShardedTree<Key, Value>::lower_bound(const Key& key) const
+{
+    size_t shard = shardFor(*splits_, key);
+    return iterator(this, shard, shards_[shard]->tree.lower_bound(key));
+}
+
+/**
+ * Every shard must be a valid AVL tree holding only keys in its range.
+ */
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::validate() const
+{
+    const Splits& splits = *splits_;
+    size_t total = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        const Tree& tree = shards_[i]->tree;
+        if (!tree.validate()) {
+            return false;
+        }
+        for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if (shardFor(splits, it->first) != i) {
+                return false;
+            }
+        }
+        total += tree.size();
+    }
+    return total == size_;
+}
+
+template<class Key, class Value>
+void ShardedTree<Key, Value>::print() const
+{
+    for (iterator it = begin(); it != end(); ++it) {
+        std::cout << '(' << it->first << ", " << it->second << ") ";
+    }
+    std::cout << "\n";
+}
+
+#endif
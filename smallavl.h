@@ -0,0 +1,504 @@
+#ifndef SMALLAVL_H
+#define SMALLAVL_H
+
+#include <iostream>
+#include <utility>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <new>
+#include "avlbst.h"
+
+/**
+ * An ordered map for workloads made of very many tiny maps.
+ *
+ * Up to N entries are kept inline, sorted, in the map object itself and
+ * found with a branch-free linear count, so a small map costs no heap
+ * allocation at all. Inserting entry N + 1 moves everything into a heap
+ * AVLTree; removals only move back to the inline array once the tree
+ * holds N / 2 entries, so a size hovering around N does not thrash.
+ * For int -> int and N = 16 the whole map is 144 bytes, where an AVLTree
+ * spends about 64 bytes of heap per entry (1 KB at 15 entries).
+ *
+ * The public interface mirrors AVLTree. Differences:
+ *  - inline iterators are invalidated by any insert or remove, and all
+ *    iterators are invalidated when the map switches representation;
+ *  - not copyable; move it instead.
+ */
+template <typename Key, typename Value, size_t N = 16>
+class SmallAVLMap
+{
+public:
+    static_assert(N >= 2, "SmallAVLMap needs room for at least two inline entries");
+
+    typedef std::pair<const Key, Value> Item;
+
+    SmallAVLMap();
+    SmallAVLMap(SmallAVLMap&& other);
+    SmallAVLMap& operator=(SmallAVLMap&& other);
+    SmallAVLMap(const SmallAVLMap&) = delete;
+    SmallAVLMap& operator=(const SmallAVLMap&) = delete;
+    ~SmallAVLMap();
+
+    class iterator;
+    std::pair<iterator, bool> insert(const Item& keyValuePair);
+    void remove(const Key& key);
+    iterator erase(iterator pos);
+    void clear();
+    bool isBalanced() const;
+    bool validate() const;
+    void print() const;
+    bool empty() const;
+    size_t size() const;
+    bool isInline() const;
+
+    /**
+    * Walks the inline array by pointer, or wraps an AVLTree iterator
+    * once the map has been promoted.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        Item& operator*() const;
+        Item* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SmallAVLMap<Key, Value, N>;
+        explicit iterator(Item* item);
+        explicit iterator(typename AVLTree<Key, Value>::iterator treeIt);
+        Item* item_;
+        typename AVLTree<Key, Value>::iterator treeIt_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    template<typename Factory>
+    std::pair<iterator, bool> find_or_insert(const Key& key, Factory factory);
+
+protected:
+    Item* items() const;
+    size_t lowerIndex(const Key& key) const;
+    Item* insertAt(size_t index, const Key& key, const Value& value);
+    void eraseAt(size_t index);
+    void promote();
+    void demote();
+    void destroyInline();
+
+    // Non-const storage so that iterators can hand out mutable
+    // references, as BinarySearchTree::iterator does.
+    mutable typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage_[N];
+    size_t count_;
+    AVLTree<Key, Value>* tree_;   // NULL while the entries are inline
+};
+
+/*
+-----------------------------------------------------------
+Begin implementations for the SmallAVLMap::iterator class.
+-----------------------------------------------------------
+*/
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator() : item_(NULL)
+{
+
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator(Item* item) : item_(item)
+{
+
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::iterator::iterator(typename AVLTree<Key, Value>::iterator treeIt) :
+    item_(NULL), treeIt_(treeIt)
+{
+
+}
+
+template<class Key, class Value, size_t N>
+std::pair<const Key, Value>& SmallAVLMap<Key, Value, N>::iterator::operator*() const
+{
+    return item_ != NULL ? *item_ : *treeIt_;
+}
+
+template<class Key, class Value, size_t N>
+std::pair<const Key, Value>* SmallAVLMap<Key, Value, N>::iterator::operator->() const
+{
+    return &(**this);
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::iterator::operator==(const iterator& rhs) const
+{
+    return item_ == rhs.item_ && treeIt_ == rhs.treeIt_;
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator&
+SmallAVLMap<Key, Value, N>::iterator::operator++()
+{
+    if (item_ != NULL) {
+        ++item_;
+    } else {
+        ++treeIt_;
+    }
+    return *this;
+}
+
+/*
+---------------------------------------------------------
+End implementations for the SmallAVLMap::iterator class.
+---------------------------------------------------------
+*/
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap() : count_(0), tree_(NULL)
+{
+
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap(SmallAVLMap&& other) : count_(0), tree_(other.tree_)
+{
+    other.tree_ = NULL;
+    for (size_t i = 0; i < other.count_; ++i) {
+        new (&items()[i]) Item(std::move(other.items()[i]));
+    }
+    count_ = other.count_;
+    other.destroyInline();
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>& SmallAVLMap<Key, Value, N>::operator=(SmallAVLMap&& other)
+{
+    if (this != &other) {
+        clear();
+        tree_ = other.tree_;
+        other.tree_ = NULL;
+        for (size_t i = 0; i < other.count_; ++i) {
+            new (&items()[i]) Item(std::move(other.items()[i]));
+        }
+        count_ = other.count_;
+        other.destroyInline();
+    }
+    return *this;
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::~SmallAVLMap()
+{
+    clear();
+}
+
+template<class Key, class Value, size_t N>
+std::pair<const Key, Value>* SmallAVLMap<Key, Value, N>::items() const
+{
+    return reinterpret_cast<Item*>(storage_);
+}
+
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::empty() const
+{
+    return size() == 0;
+}
+
+template<class Key, class Value, size_t N>
+size_t SmallAVLMap<Key, Value, N>::size() const
+{
+    return tree_ != NULL ? tree_->size() : count_;
+}
+
+/**
+ * True while the entries live in the inline array.
+ */
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::isInline() const
+{
+    return tree_ == NULL;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::clear()
+{
+    destroyInline();
+    delete tree_;
+    tree_ = NULL;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::destroyInline()
+{
+    for (size_t i = 0; i < count_; ++i) {
+        items()[i].~Item();
+    }
+    count_ = 0;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::print() const
+{
+    if (tree_ != NULL) {
+        tree_->print();
+        return;
+    }
+    for (size_t i = 0; i < count_; ++i) {
+        std::cout << '(' << items()[i].first << ", " << items()[i].second << ") ";
+    }
+    std::cout << "\n";
+}
+
+/**
+ * A sorted array is trivially balanced.
+ */
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::isBalanced() const
+{
+    return tree_ == NULL || tree_->isBalanced();
+}
+
+/**
+ * Inline entries must be strictly increasing; a promoted map defers to
+ * AVLTree::validate().
+ */
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::validate() const
+{
+    if (tree_ != NULL) {
+        return count_ == 0 && tree_->validate();
+    }
+    for (size_t i = 1; i < count_; ++i) {
+        if (!(items()[i - 1].first < items()[i].first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::begin() const
+{
+    if (tree_ != NULL) {
+        return iterator(tree_->begin());
+    }
+    return iterator(items());
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::end() const
+{
+    if (tree_ != NULL) {
+        return iterator(tree_->end());
+    }
+    return iterator(items() + count_);
+}
+
+/**
+ * Index of the first inline entry whose key is not less than key.
+ * Counts instead of branching on each comparison, which is as fast as
+ * a binary search at these sizes and lets the compiler vectorise it
+ * for arithmetic keys.
+ */
+template<class Key, class Value, size_t N>
+size_t SmallAVLMap<Key, Value, N>::lowerIndex(const Key& key) const
+{
+    const Item* item = items();
+    size_t index = 0;
+    for (size_t i = 0; i < count_; ++i) {
+        index += (item[i].first < key);
+    }
+    return index;
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::find(const Key& key) const
+{
+    if (tree_ != NULL) {
+        return iterator(tree_->find(key));
+    }
+    size_t index = lowerIndex(key);
+    if (index < count_ && !(key < items()[index].first)) {
+        return iterator(items() + index);
+    }
+    return end();
+}
+
+/**
+ * Returns the value associated with the key, inserting a
+ * default-constructed value first if the key is missing.
+ */
+template<class Key, class Value, size_t N>
+Value& SmallAVLMap<Key, Value, N>::operator[](const Key& key)
+{
+    return find_or_insert(key, [] { return Value(); }).first->second;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, size_t N>
+Value const & SmallAVLMap<Key, Value, N>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is present.
+ * Returns an iterator to the key and whether a new entry was created.
+ */
+template<class Key, class Value, size_t N>
+std::pair<typename SmallAVLMap<Key, Value, N>::iterator, bool>
+SmallAVLMap<Key, Value, N>::insert(const Item& keyValuePair)
+{
+    std::pair<iterator, bool> result = find_or_insert(keyValuePair.first,
+        [&keyValuePair] { return keyValuePair.second; });
+    if (!result.second) {
+        result.first->second = keyValuePair.second;
+    }
+    return result;
+}
+
+/**
+ * Returns an iterator to the key's entry and false if the key is
+ * present. Otherwise inserts factory() under the key and returns true;
+ * the factory is only called when an entry is created.
+ */
+template<class Key, class Value, size_t N>
+template<typename Factory>
+std::pair<typename SmallAVLMap<Key, Value, N>::iterator, bool>
+SmallAVLMap<Key, Value, N>::find_or_insert(const Key& key, Factory factory)
+{
+    if (tree_ == NULL) {
+        size_t index = lowerIndex(key);
+        if (index < count_ && !(key < items()[index].first)) {
+            return std::make_pair(iterator(items() + index), false);
+        }
+        if (count_ < N) {
+            return std::make_pair(iterator(insertAt(index, key, factory())), true);
+        }
+        promote();
+    }
+    std::pair<typename AVLTree<Key, Value>::iterator, bool> result = tree_->find_or_insert(key, factory);
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::remove(const Key& key)
+{
+    if (tree_ != NULL) {
+        tree_->remove(key);
+        if (tree_->size() <= N / 2) {
+            demote();
+        }
+        return;
+    }
+    size_t index = lowerIndex(key);
+    if (index < count_ && !(key < items()[index].first)) {
+        eraseAt(index);
+    }
+}
+
+/**
+ * Removes the entry at pos, which must be valid, and returns an iterator
+ * to the key after it.
+ */
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::erase(iterator pos)
+{
+    if (tree_ == NULL) {
+        size_t index = pos.item_ - items();
+        eraseAt(index);
+        return iterator(items() + index);
+    }
+    typename AVLTree<Key, Value>::iterator next = tree_->erase(pos.treeIt_);
+    if (tree_->size() > N / 2) {
+        return iterator(next);
+    }
+    if (next == tree_->end()) {
+        demote();
+        return end();
+    }
+    Key nextKey(next->first);
+    demote();
+    return find(nextKey);
+}
+
+/**
+ * Opens a gap at index by moving the entries above it up one slot and
+ * constructs the new entry there.
+ */
+template<class Key, class Value, size_t N>
+std::pair<const Key, Value>* SmallAVLMap<Key, Value, N>::insertAt(size_t index, const Key& key, const Value& value)
+{
+    Item* item = items();
+    for (size_t i = count_; i > index; --i) {
+        new (&item[i]) Item(std::move(item[i - 1]));
+        item[i - 1].~Item();
+    }
+    new (&item[index]) Item(key, value);
+    count_++;
+    return &item[index];
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::eraseAt(size_t index)
+{
+    Item* item = items();
+    item[index].~Item();
+    for (size_t i = index + 1; i < count_; ++i) {
+        new (&item[i - 1]) Item(std::move(item[i]));
+        item[i].~Item();
+    }
+    count_--;
+}
+
+/**
+ * Moves the inline entries into a new AVLTree.
+ */
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::promote()
+{
+    AVLTree<Key, Value>* tree = new AVLTree<Key, Value>();
+    for (size_t i = 0; i < count_; ++i) {
+        tree->insert(items()[i]);
+    }
+    destroyInline();
+    tree_ = tree;
+}
+
+/**
+ * Moves the tree's entries back inline and frees the tree. Called with
+ * at most N / 2 entries, so they always fit.
+ */
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::demote()
+{
+    AVLTree<Key, Value>* tree = tree_;
+    tree_ = NULL;
+    for (typename AVLTree<Key, Value>::iterator it = tree->begin(); it != tree->end(); ++it) {
+        new (&items()[count_]) Item(it->first, std::move(it->second));
+        count_++;
+    }
+    delete tree;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include "hashmix.h"
+
+// Operation traces. A tree with a TraceRecorder attached (see
+// BinarySearchTree::setRecorder) logs each insert, find, remove and scan
+// start as one record:
+//
+//     op byte | varint nanoseconds since the previous record | key hash
+//
+// The key hash is 8 bytes, little endian, and is left out of scans that
+// start at begin(). Keys themselves never reach the trace, so a trace
+// reproduces which keys repeat and how the operations mix, but not key
+// order. Records are buffered and written TRACE_BUFFER_BYTES at a time.
+
+enum TraceOp
+{
+    TRACE_INSERT = 0,       // insert(), or operator[] / find_or_insert() that created the key
+    TRACE_FIND = 1,         // find(), or operator[] / find_or_insert() on a present key
+    TRACE_REMOVE = 2,       // remove(), erase(), extract()
+    TRACE_ITERATE = 3       // begin(), lower_bound(), upper_bound()
+};
+
+// Bits or'ed into the op byte.
+#define TRACE_OP_MASK 0x0f
+#define TRACE_FROM_START 0x40   // ITERATE from begin(): no key hash follows
+#define TRACE_PRELOAD 0x80      // INSERT of a key already in the tree when recording began
+
+#define TRACE_BUFFER_BYTES (64 << 10)
+
+static const char TRACE_MAGIC[8] = { 'A', 'V', 'L', 'T', 'R', 'C', 'E', '1' };
+
+/**
+ * std::hash of the key, mixed so that identity hashes of integers spread
+ * over all 64 bits. Keys without a std::hash all trace as 0.
+ */
+template <typename Key, typename = void>
+struct TraceKeyHash
+{
+    uint64_t operator()(const Key&) const { return 0; }
+};
+
+template <typename Key>
+struct TraceKeyHash<Key, decltype(void(std::hash<Key>()(std::declval<const Key&>())))>
+{
+    uint64_t operator()(const Key& key) const
+    {
+        return mixHash(static_cast<uint64_t>(std::hash<Key>()(key)));
+    }
+};
+
+/**
+ * Writes a trace to a stream. Not synchronized: trees sharing a recorder
+ * must not be used from several threads at once.
+ */
+class TraceRecorder
+{
+public:
+    explicit TraceRecorder(std::ostream& out);
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    void record(uint8_t op, uint64_t keyHash);
+    void flush();
+    uint64_t records() const;
+    uint64_t bytes() const;
+
+protected:
+    void putVarint(uint64_t value);
+
+    std::ostream& out_;
+    std::vector<uint8_t> buffer_;
+    std::chrono::steady_clock::time_point last_;
+    uint64_t records_;
+    uint64_t bytes_;
+};
+
+inline TraceRecorder::TraceRecorder(std::ostream& out) :
+    out_(out), last_(std::chrono::steady_clock::now()), records_(0), bytes_(sizeof(TRACE_MAGIC))
+{
+    buffer_.reserve(TRACE_BUFFER_BYTES + 32);
+    out_.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+}
+
+inline TraceRecorder::~TraceRecorder()
+{
+    flush();
+}
+
+inline void TraceRecorder::putVarint(uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer_.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * op is a TraceOp plus any TRACE_FROM_START / TRACE_PRELOAD bits.
+ */
+inline void TraceRecorder::record(uint8_t op, uint64_t keyHash)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    uint64_t delta = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+    last_ = now;
+
+    size_t start = buffer_.size();
+    buffer_.push_back(op);
+    putVarint(delta);
+    if (!(op & TRACE_FROM_START)) {
+        for (int i = 0; i < 8; ++i) {
+            buffer_.push_back(static_cast<uint8_t>(keyHash >> (8 * i)));
+        }
+    }
+    bytes_ += buffer_.size() - start;
+    records_++;
+    if (buffer_.size() >= TRACE_BUFFER_BYTES) {
+        flush();
+    }
+}
+
+inline void TraceRecorder::flush()
+{
+    if (!buffer_.empty()) {
+        out_.write(reinterpret_cast<const char*>(&buffer_[0]), buffer_.size());
+        buffer_.clear();
+    }
+    out_.flush();
+}
+
+inline uint64_t TraceRecorder::records() const
+{
+    return records_;
+}
+
+inline uint64_t TraceRecorder::bytes() const
+{
+    return bytes_;
+}
+
+/**
+ * One decoded record; nanos counts from the start of recording.
+ */
+struct TraceRecord
+{
+    uint8_t op;         // TraceOp
+    uint8_t flags;      // TRACE_FROM_START, TRACE_PRELOAD
+    uint64_t nanos;
+    uint64_t keyHash;
+};
+
+/**
+ * Reads back what a TraceRecorder wrote. The constructor throws
+ * std::runtime_error if the stream does not start like a trace.
+ */
+class TraceReader
+{
+public:
+    explicit TraceReader(std::istream& in);
+
+    bool next(TraceRecord& record);
+
+protected:
+    bool getVarint(uint64_t& value);
+
+    std::istream& in_;
+    uint64_t nanos_;
+};
+
+inline TraceReader::TraceReader(std::istream& in) : in_(in), nanos_(0)
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    if (!in_.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("trace: not a trace file");
+    }
+}
+
+inline bool TraceReader::getVarint(uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in_.get();
+        if (c == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns false at the end of the trace, including a record cut short
+ * by a recorder that was never flushed.
+ */
+inline bool TraceReader::next(TraceRecord& record)
+{
+    int op = in_.get();
+    uint64_t delta;
+    if (op == EOF || !getVarint(delta)) {
+        return false;
+    }
+    record.op = static_cast<uint8_t>(op & TRACE_OP_MASK);
+    record.flags = static_cast<uint8_t>(op & ~TRACE_OP_MASK);
+    nanos_ += delta;
+    record.nanos = nanos_;
+    record.keyHash = 0;
+    if (!(op & TRACE_FROM_START)) {
+        unsigned char bytes[8];
+        if (!in_.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+            return false;
+        }
+        for (int i = 0; i < 8; ++i) {
+            record.keyHash |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        }
+    }
+    return true;
+}
+
+#endif
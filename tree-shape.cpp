@@ -0,0 +1,170 @@
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "tree-shape.h"
+
+using namespace std;
+
+bool TreeShape::equalPaths() const
+{
+    size_t depths = 0;
+    for (size_t d = 0; d < leafDepths.size(); ++d) {
+        if (leafDepths[d] != 0) {
+            depths++;
+        }
+    }
+    return depths <= 1;
+}
+
+TreeShape analyzeShape(Node* root)
+{
+    TreeShape shape;
+    if (!root) {
+        return shape;
+    }
+
+    vector<pair<Node*, size_t> > stack;
+    stack.push_back(make_pair(root, size_t(0)));
+    while (!stack.empty()) {
+        Node* node = stack.back().first;
+        size_t depth = stack.back().second;
+        stack.pop_back();
+
+        shape.nodes++;
+        shape.height = max(shape.height, depth + 1);
+        shape.internalPathLength += depth;
+        if (!node->left && !node->right) {
+            if (shape.leafDepths.size() <= depth) {
+                shape.leafDepths.resize(depth + 1);
+            }
+            shape.leafDepths[depth]++;
+            continue;
+        }
+        if (node->right) stack.push_back(make_pair(node->right, depth + 1));
+        if (node->left) stack.push_back(make_pair(node->left, depth + 1));
+    }
+    return shape;
+}
+
+namespace {
+
+// Subtrees handed to each thread, per thread, so that an unlucky split
+// still leaves work to share.
+const size_t SUBTREES_PER_THREAD = 8;
+
+// Nodes a worker checks between looks at the cancellation flag.
+const size_t CANCEL_CHECK_INTERVAL = 1024;
+
+struct ParallelCheck
+{
+    vector<pair<Node*, int> > subtrees;
+    atomic<size_t> next;
+    atomic<int> leafDepth;  // -1 until some thread finds a leaf
+    atomic<bool> failed;
+
+    ParallelCheck() : next(0), leafDepth(-1), failed(false) {}
+
+    // false if a leaf at depth disagrees with the shared leaf depth
+    bool leafAt(int depth)
+    {
+        int expected = -1;
+        return leafDepth.compare_exchange_strong(expected, depth) || expected == depth;
+    }
+
+    // false if an internal node at depth is too deep to have good leaves
+    bool internalAt(int depth) const
+    {
+        int seen = leafDepth.load(memory_order_relaxed);
+        return seen == -1 || depth < seen;
+    }
+
+    bool checkSubtree(Node* node, int depth)
+    {
+        vector<pair<Node*, int> > stack;
+        stack.push_back(make_pair(node, depth));
+        size_t visited = 0;
+        while (!stack.empty()) {
+            if (++visited % CANCEL_CHECK_INTERVAL == 0 && failed.load(memory_order_relaxed)) {
+                return true;
+            }
+            Node* curr = stack.back().first;
+            int d = stack.back().second;
+            stack.pop_back();
+            if (!curr->left && !curr->right) {
+                if (!leafAt(d)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!internalAt(d)) {
+                return false;
+            }
+            if (curr->right) stack.push_back(make_pair(curr->right, d + 1));
+            if (curr->left) stack.push_back(make_pair(curr->left, d + 1));
+        }
+        return true;
+    }
+
+    void work()
+    {
+        while (!failed.load(memory_order_relaxed)) {
+            size_t i = next.fetch_add(1);
+            if (i >= subtrees.size()) {
+                return;
+            }
+            if (!checkSubtree(subtrees[i].first, subtrees[i].second)) {
+                failed.store(true);
+            }
+        }
+    }
+};
+
+}
+
+bool equalPathsParallel(Node* root, unsigned threads)
+{
+    if (!root) {
+        return true;
+    }
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
+    // Expand the top of the tree a level at a time until there are enough
+    // subtrees to share. Leaves met on the way are checked here.
+    ParallelCheck check;
+    vector<pair<Node*, int> > level(1, make_pair(root, 0));
+    size_t target = threads > 1 ? threads * SUBTREES_PER_THREAD : 1;
+    while (!level.empty() && level.size() < target) {
+        vector<pair<Node*, int> > below;
+        for (size_t i = 0; i < level.size(); ++i) {
+            Node* node = level[i].first;
+            int depth = level[i].second;
+            if (!node->left && !node->right) {
+                if (!check.leafAt(depth)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!check.internalAt(depth)) {
+                return false;
+            }
+            if (node->left) below.push_back(make_pair(node->left, depth + 1));
+            if (node->right) below.push_back(make_pair(node->right, depth + 1));
+        }
+        level.swap(below);
+    }
+    check.subtrees.swap(level);
+
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads && t < check.subtrees.size(); ++t) {
+        workers.push_back(thread(&ParallelCheck::work, &check));
+    }
+    check.work();
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    return !check.failed.load();
+}
@@ -0,0 +1,42 @@
+#ifndef TREE_SHAPE_H
+#define TREE_SHAPE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "equal-paths.h"
+
+/**
+ * Shape of a Node tree, gathered by analyzeShape() in one pass.
+ * Depths count edges from the root, so the root is at depth 0.
+ */
+struct TreeShape
+{
+    size_t nodes;
+    size_t height;                  // levels; 0 for an empty tree
+    uint64_t internalPathLength;    // sum of the depths of all nodes, leaves included
+    std::vector<size_t> leafDepths; // leafDepths[d] is the number of leaves at depth d
+
+    TreeShape() : nodes(0), height(0), internalPathLength(0) {}
+
+    /**
+     * Same answer as equalPaths() on the analyzed tree.
+     */
+    bool equalPaths() const;
+};
+
+/**
+ * Walks the whole tree once with an explicit stack; safe on degenerate
+ * trees of any depth.
+ */
+TreeShape analyzeShape(Node* root);
+
+/**
+ * equalPaths() for very large trees: the top levels are split into
+ * subtrees that threads (0 means one per core) check concurrently. The
+ * first leaf depth found is shared, and the first mismatch cancels every
+ * other thread.
+ */
+bool equalPathsParallel(Node* root, unsigned threads = 0);
+
+#endif
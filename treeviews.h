@@ -0,0 +1,330 @@
+#ifndef TREEVIEWS_H
+#define TREEVIEWS_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "bst.h"
+
+// Lazy ordered views over several trees. Views hold pointers to the trees
+// and read them in place: the trees must outlive the view and must not be
+// changed while one of its iterators is in use.
+
+/**
+ * The union of several trees in key order, produced one item at a time
+ * from a heap holding each tree's next iterator. Each step costs
+ * O(log k) for k trees on top of the tree's own ++. A key present in
+ * several trees is produced once per tree, in the order the trees were
+ * added; source() tells them apart.
+ */
+template <typename Key, typename Value>
+class MergeView
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator tree_iterator;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+        size_t source() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class MergeView<Key, Value>;
+
+        struct Head
+        {
+            tree_iterator it;
+            tree_iterator end;
+            size_t source;
+        };
+
+        static bool later(const Head& a, const Head& b);
+
+        std::vector<Head> heap_;    // heap_.front() is the next item
+    };
+
+    void add(const BinarySearchTree<Key, Value>& tree);
+    size_t trees() const;
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    std::vector<const BinarySearchTree<Key, Value>*> trees_;
+};
+
+template<class Key, class Value>
+MergeView<Key, Value>::iterator::iterator()
+{
+
+}
+
+/**
+ * Orders the heap so that the smallest key, and among equal keys the
+ * earliest tree, comes out first.
+ */
+template<class Key, class Value>
+bool MergeView<Key, Value>::iterator::later(const Head& a, const Head& b)
+{
+    if (b.it->first < a.it->first) {
+        return true;
+    }
+    if (a.it->first < b.it->first) {
+        return false;
+    }
+    return a.source > b.source;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& MergeView<Key, Value>::iterator::operator*() const
+{
+    return *heap_.front().it;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* MergeView<Key, Value>::iterator::operator->() const
+{
+    return &*heap_.front().it;
+}
+
+/**
+ * Index, in the order of add(), of the tree holding the current item.
+ */
+template<class Key, class Value>
+size_t MergeView<Key, Value>::iterator::source() const
+{
+    return heap_.front().source;
+}
+
+template<class Key, class Value>
+bool MergeView<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    if (heap_.empty() || rhs.heap_.empty()) {
+        return heap_.empty() == rhs.heap_.empty();
+    }
+    return heap_.front().it == rhs.heap_.front().it;
+}
+
+template<class Key, class Value>
+bool MergeView<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename MergeView<Key, Value>::iterator& MergeView<Key, Value>::iterator::operator++()
+{
+    std::pop_heap(heap_.begin(), heap_.end(), later);
+    Head& head = heap_.back();
+    ++head.it;
+    if (head.it == head.end) {
+        heap_.pop_back();
+    }
+    else {
+        std::push_heap(heap_.begin(), heap_.end(), later);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+void MergeView<Key, Value>::add(const BinarySearchTree<Key, Value>& tree)
+{
+    trees_.push_back(&tree);
+}
+
+template<class Key, class Value>
+size_t MergeView<Key, Value>::trees() const
+{
+    return trees_.size();
+}
+
+template<class Key, class Value>
+typename MergeView<Key, Value>::iterator MergeView<Key, Value>::begin() const
+{
+    iterator it;
+    it.heap_.reserve(trees_.size());
+    for (size_t i = 0; i < trees_.size(); ++i) {
+        typename iterator::Head head = { trees_[i]->begin(), trees_[i]->end(), i };
+        if (head.it != head.end) {
+            it.heap_.push_back(head);
+        }
+    }
+    std::make_heap(it.heap_.begin(), it.heap_.end(), iterator::later);
+    return it;
+}
+
+template<class Key, class Value>
+typename MergeView<Key, Value>::iterator MergeView<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+ * Keys present in both of two trees, in order, with an iterator into
+ * each. Whichever side is behind jumps straight to the other side's key
+ * with a cursor seek (see BinarySearchTree::cursor) instead of stepping,
+ * so a join of m keys against n costs about O(m log(n/m)) rather than
+ * O(m + n) when m is much smaller.
+ */
+template <typename Key, typename LValue, typename RValue>
+class JoinView
+{
+public:
+    typedef typename BinarySearchTree<Key, LValue>::iterator left_iterator;
+    typedef typename BinarySearchTree<Key, RValue>::iterator right_iterator;
+
+    class iterator
+    {
+    public:
+        const Key& key() const;
+        left_iterator left() const;
+        right_iterator right() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class JoinView<Key, LValue, RValue>;
+        iterator(const BinarySearchTree<Key, LValue>& a, const BinarySearchTree<Key, RValue>& b, bool atEnd);
+        void leapfrog();
+
+        typename BinarySearchTree<Key, LValue>::cursor leftCursor_;
+        typename BinarySearchTree<Key, RValue>::cursor rightCursor_;
+        left_iterator left_;
+        left_iterator leftEnd_;
+        right_iterator right_;
+        right_iterator rightEnd_;
+    };
+
+    JoinView(const BinarySearchTree<Key, LValue>& a, const BinarySearchTree<Key, RValue>& b);
+
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    const BinarySearchTree<Key, LValue>* a_;
+    const BinarySearchTree<Key, RValue>* b_;
+};
+
+template<class Key, class LValue, class RValue>
+JoinView<Key, LValue, RValue>::iterator::iterator(const BinarySearchTree<Key, LValue>& a,
+                                                  const BinarySearchTree<Key, RValue>& b, bool atEnd) :
+    leftCursor_(a), rightCursor_(b),
+    left_(atEnd ? a.end() : a.begin()), leftEnd_(a.end()),
+    right_(atEnd ? b.end() : b.begin()), rightEnd_(b.end())
+{
+    leapfrog();
+}
+
+/**
+ * Moves the side that is behind up to the other side's key until both
+ * sit on the same key, or either runs out (which makes this end()).
+ */
+template<class Key, class LValue, class RValue>
+void JoinView<Key, LValue, RValue>::iterator::leapfrog()
+{
+    while (left_ != leftEnd_ && right_ != rightEnd_) {
+        if (left_->first < right_->first) {
+            left_ = leftCursor_.seek_lower(right_->first);
+        }
+        else if (right_->first < left_->first) {
+            right_ = rightCursor_.seek_lower(left_->first);
+        }
+        else {
+            return;
+        }
+    }
+    left_ = leftEnd_;
+    right_ = rightEnd_;
+}
+
+template<class Key, class LValue, class RValue>
+const Key& JoinView<Key, LValue, RValue>::iterator::key() const
+{
+    return left_->first;
+}
+
+template<class Key, class LValue, class RValue>
+typename JoinView<Key, LValue, RValue>::left_iterator JoinView<Key, LValue, RValue>::iterator::left() const
+{
+    return left_;
+}
+
+template<class Key, class LValue, class RValue>
+typename JoinView<Key, LValue, RValue>::right_iterator JoinView<Key, LValue, RValue>::iterator::right() const
+{
+    return right_;
+}
+
+template<class Key, class LValue, class RValue>
+bool JoinView<Key, LValue, RValue>::iterator::operator==(const iterator& rhs) const
+{
+    return left_ == rhs.left_ && right_ == rhs.right_;
+}
+
+template<class Key, class LValue, class RValue>
+bool JoinView<Key, LValue, RValue>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class LValue, class RValue>
+typename JoinView<Key, LValue, RValue>::iterator& JoinView<Key, LValue, RValue>::iterator::operator++()
+{
+    ++left_;
+    ++right_;
+    leapfrog();
+    return *this;
+}
+
+template<class Key, class LValue, class RValue>
+JoinView<Key, LValue, RValue>::JoinView(const BinarySearchTree<Key, LValue>& a, const BinarySearchTree<Key, RValue>& b) :
+    a_(&a), b_(&b)
+{
+
+}
+
+template<class Key, class LValue, class RValue>
+typename JoinView<Key, LValue, RValue>::iterator JoinView<Key, LValue, RValue>::begin() const
+{
+    return iterator(*a_, *b_, false);
+}
+
+template<class Key, class LValue, class RValue>
+typename JoinView<Key, LValue, RValue>::iterator JoinView<Key, LValue, RValue>::end() const
+{
+    return iterator(*a_, *b_, true);
+}
+
+/**
+ * merge_view(a, b, c) merges any number of trees with the same key and
+ * value types. For a number of trees only known at run time, add() them
+ * to a MergeView.
+ */
+template <typename Key, typename Value, typename... Trees>
+MergeView<Key, Value> merge_view(const BinarySearchTree<Key, Value>& first, const Trees&... rest)
+{
+    MergeView<Key, Value> view;
+    view.add(first);
+    int expand[] = { 0, (view.add(rest), 0)... };
+    (void)expand;
+    return view;
+}
+
+template <typename Key, typename LValue, typename RValue>
+JoinView<Key, LValue, RValue> join_view(const BinarySearchTree<Key, LValue>& a, const BinarySearchTree<Key, RValue>& b)
+{
+    return JoinView<Key, LValue, RValue>(a, b);
+}
+
+#endif
@@ -0,0 +1,100 @@
+// AVLTree vs. OutOfLineAVLTree with 200-byte values: key-only lookups,
+// lookups that read the value, key scans and memory.
+//
+//   make value-bench
+//   ./value-bench [keys]
+//
+// "contains" only compares find() with end(); "find+value" also reads
+// a field of the value; "scan keys" sums every key in order.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+#include "outoflineavl.h"
+#include "memusage.h"
+#include "benchrand.h"
+
+using namespace std;
+
+struct Record
+{
+    uint64_t id;
+    char payload[192];
+};
+
+ostream& operator<<(ostream& os, const Record& record)
+{
+    return os << record.id;
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template<typename Tree>
+static void run(const char* name, const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    size_t heapBefore = AllocatorStats::current().inUseBytes;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Tree* tree = new Tree;
+    Record record = Record();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        record.id = i;
+        tree->insert(make_pair(keys[i], record));
+    }
+    double insertSec = secondsSince(start);
+    size_t heap = AllocatorStats::current().inUseBytes - heapBefore;
+
+    uint64_t sum = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        sum += tree->find(probes[i]) != tree->end();
+    }
+    double containsSec = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        const Record& value = tree->find(probes[i])->second;
+        sum += value.id;
+    }
+    double valueSec = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (typename Tree::iterator it = tree->begin(); it != tree->end(); ++it) {
+        sum += it->first;
+    }
+    double scanSec = secondsSince(start);
+
+    cout << setw(12) << name << fixed << setprecision(1) << setw(10) << double(heap) / keys.size()
+         << setw(10) << insertSec * 1e9 / keys.size() << setw(11) << containsSec * 1e9 / probes.size()
+         << setw(13) << valueSec * 1e9 / probes.size() << setw(12) << scanSec * 1e9 / keys.size()
+         << "   [" << sum % 10 << "]" << endl;
+    delete tree;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t state = 88172645463325252ull;
+
+    vector<uint64_t> keys(count), probes(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        keys[i] = nextRand(state);
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        probes[i] = keys[nextRand(state) % count];
+    }
+
+    cout << count << " keys, " << sizeof(Record) << "-byte values; AVLNode " << sizeof(AVLNode<uint64_t, Record>)
+         << " bytes, out-of-line node " << sizeof(AVLNode<uint64_t, ValueRef<Record> >) << " bytes" << endl;
+    cout << setw(12) << "tree" << setw(10) << "heap/key" << setw(10) << "insert" << setw(11) << "contains"
+         << setw(13) << "find+value" << setw(12) << "scan keys" << "   (ns)" << endl;
+    run<AVLTree<uint64_t, Record> >("inline", keys, probes);
+    run<ValueSizedAVLTree<uint64_t, Record> >("out-of-line", keys, probes);
+    return 0;
+}
@@ -0,0 +1,123 @@
+// merge_view() and join_view() against the obvious alternatives.
+//
+//   make view-bench
+//   ./view-bench [keys] [partitions]
+//
+// Merge: the partitions' union in order through merge_view() vs. copying
+// every key out and sorting. Join: join_view() vs. a linear merge join
+// that steps both sides, for a small tree against a large one at several
+// size ratios.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+#include "treeviews.h"
+#include "benchrand.h"
+
+using namespace std;
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+    size_t partitions = argc > 2 ? strtoull(argv[2], NULL, 10) : 16;
+    uint64_t state = 2463534242ull;
+
+    vector<Tree> parts(partitions);
+    for (size_t i = 0; i < keys; ++i) {
+        uint64_t k = nextRand(state);
+        parts[k % partitions].insert(make_pair(k, i));
+    }
+
+    MergeView<uint64_t, uint64_t> view;
+    for (size_t p = 0; p < partitions; ++p) {
+        view.add(parts[p]);
+    }
+    uint64_t merged = 0, last = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (MergeView<uint64_t, uint64_t>::iterator it = view.begin(); it != view.end(); ++it) {
+        if (it->first < last) {
+            cerr << "view-bench: merge_view out of order" << endl;
+            return 1;
+        }
+        last = it->first;
+        merged++;
+    }
+    double mergeSec = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    vector<uint64_t> sorted;
+    sorted.reserve(keys);
+    for (size_t p = 0; p < partitions; ++p) {
+        for (Tree::iterator it = parts[p].begin(); it != parts[p].end(); ++it) {
+            sorted.push_back(it->first);
+        }
+    }
+    sort(sorted.begin(), sorted.end());
+    double sortSec = secondsSince(start);
+
+    cout << merged << " keys in " << partitions << " partitions" << fixed << setprecision(1) << endl;
+    cout << "  merge_view   " << setw(8) << mergeSec * 1e3 << " ms" << endl;
+    cout << "  copy + sort  " << setw(8) << sortSec * 1e3 << " ms" << endl;
+
+    // join: every key of the small tree is also in the large one
+    const Tree& large = parts[0];
+    vector<uint64_t> largeKeys;
+    for (Tree::iterator it = large.begin(); it != large.end(); ++it) {
+        largeKeys.push_back(it->first);
+    }
+
+    cout << "\njoin against " << large.size() << " keys" << endl;
+    cout << setw(10) << "small" << setw(14) << "join_view ms" << setw(16) << "merge join ms" << setw(10) << "speedup" << endl;
+    for (size_t ratio = 1; ratio <= largeKeys.size(); ratio *= 10) {
+        Tree small;
+        for (size_t i = 0; i < largeKeys.size(); i += ratio) {
+            small.insert(make_pair(largeKeys[i], i));
+        }
+
+        size_t leapHits = 0;
+        start = chrono::steady_clock::now();
+        JoinView<uint64_t, uint64_t, uint64_t> join = join_view(small, large);
+        for (JoinView<uint64_t, uint64_t, uint64_t>::iterator it = join.begin(); it != join.end(); ++it) {
+            leapHits++;
+        }
+        double leapSec = secondsSince(start);
+
+        size_t stepHits = 0;
+        start = chrono::steady_clock::now();
+        Tree::iterator a = small.begin(), b = large.begin();
+        while (a != small.end() && b != large.end()) {
+            if (a->first < b->first) {
+                ++a;
+            }
+            else if (b->first < a->first) {
+                ++b;
+            }
+            else {
+                stepHits++;
+                ++a;
+                ++b;
+            }
+        }
+        double stepSec = secondsSince(start);
+
+        if (leapHits != stepHits || leapHits != small.size()) {
+            cerr << "view-bench: joins disagree" << endl;
+            return 1;
+        }
+        cout << setw(10) << small.size() << setprecision(2) << setw(14) << leapSec * 1e3
+             << setw(16) << stepSec * 1e3 << setw(9) << stepSec / leapSec << "x" << endl;
+    }
+    return 0;
+}